@@ -0,0 +1,369 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "big_integer.h"
+#include "limb_kernels.h"
+
+namespace {
+
+BigInteger RandomInteger(size_t limbs, std::mt19937_64& generator) {
+  // 64 * log10(2) decimal digits per limb.
+  size_t digits = static_cast<size_t>(static_cast<double>(limbs) * 19.2659);
+  std::uniform_int_distribution<int> digit(0, 9);
+
+  std::string str(digits, '0');
+  for (auto& chr : str) {
+    chr = static_cast<char>('0' + digit(generator));
+  }
+  str[0] = '9';
+
+  return BigInteger(str.c_str());
+}
+
+enum class Operation { kMultiplication, kDivision, kToString, kParse, kGcd };
+
+struct Operands {
+  BigInteger lhs;
+  BigInteger rhs;
+  std::string decimal;
+};
+
+// Random operands of `limbs` limbs, with a dividend twice as long.
+Operands MakeOperands(Operation operation, size_t limbs,
+                      std::mt19937_64& generator) {
+  Operands operands;
+  size_t lhs_limbs = operation == Operation::kDivision ? 2 * limbs : limbs;
+  operands.lhs = RandomInteger(lhs_limbs, generator);
+  operands.rhs = RandomInteger(limbs, generator);
+  if (operation == Operation::kParse) {
+    operands.decimal = operands.lhs.ToString();
+  }
+  return operands;
+}
+
+// Runs `operation` once. The result is checked against an impossible value so
+// that the compiler cannot drop the work.
+bool Run(Operation operation, const Operands& operands) {
+  switch (operation) {
+    case Operation::kMultiplication:
+      return static_cast<bool>(operands.lhs * operands.rhs);
+    case Operation::kDivision:
+      return static_cast<bool>(operands.lhs / operands.rhs);
+    case Operation::kToString:
+      return !operands.lhs.ToString().empty();
+    case Operation::kParse:
+      return static_cast<bool>(BigInteger(operands.decimal.c_str()));
+    case Operation::kGcd:
+      return static_cast<bool>(BigInteger::Gcd(operands.lhs, operands.rhs));
+  }
+  return false;
+}
+
+// Microseconds per run of `operation`: the best of five runs of at least
+// 10 ms each, which filters out most scheduler noise.
+double Measure(Operation operation, const Operands& operands) {
+  using Clock = std::chrono::steady_clock;
+
+  double best = 0;
+  for (int run = 0; run < 5; ++run) {
+    size_t iterations = 0;
+    auto start = Clock::now();
+    auto elapsed = Clock::duration::zero();
+
+    while (elapsed < std::chrono::milliseconds(10)) {
+      if (!Run(operation, operands)) {
+        std::cerr << "unexpected zero result\n";
+      }
+      ++iterations;
+      elapsed = Clock::now() - start;
+    }
+
+    double average =
+        std::chrono::duration<double, std::micro>(elapsed).count() /
+        static_cast<double>(iterations);
+    best = (run == 0) ? average : std::min(best, average);
+  }
+
+  return best;
+}
+
+// Compares one level of the algorithm selected by `threshold` against the
+// next smaller algorithm, for operands between `from` and `to` limbs. The
+// crossover is the first size after which the split
+// wins twice in a row.
+size_t FindCrossover(const char* name, size_t BigIntegerThresholds::*threshold,
+                     Operation operation, size_t from, size_t to, size_t step,
+                     std::mt19937_64& generator) {
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+
+  std::cout << name << " crossover\n"
+            << std::setw(8) << "limbs" << std::setw(16) << "without, us"
+            << std::setw(16) << "with, us" << '\n';
+
+  size_t crossover = 0;
+  size_t wins = 0;
+  for (size_t limbs = from; limbs <= to; limbs += step) {
+    Operands operands = MakeOperands(operation, limbs, generator);
+
+    thresholds.*threshold = limbs + 1;
+    double without = Measure(operation, operands);
+    thresholds.*threshold = limbs;
+    double with = Measure(operation, operands);
+
+    std::cout << std::setw(8) << limbs << std::fixed << std::setprecision(2)
+              << std::setw(16) << without << std::setw(16) << with << '\n';
+
+    wins = with < without ? wins + 1 : 0;
+    if (wins == 2 && crossover == 0) {
+      crossover = limbs - step;
+    }
+  }
+
+  if (crossover == 0) {
+    crossover = to;
+  }
+
+  thresholds.*threshold = crossover;
+  std::cout << '\n';
+  return crossover;
+}
+
+// Finds the smallest part size worth a thread on `threads` threads.
+// Operands of 2 * part limbs are multiplied serially and with
+// parallel_limbs = part, which forks the top split and nothing below it.
+// The crossover is the first part size after which forking wins twice in a
+// row.
+size_t FindParallelCrossover(size_t threads, size_t from, size_t to,
+                             std::mt19937_64& generator) {
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+  BigInteger::SetThreads(threads);
+
+  std::cout << "Parallel crossover on " << threads << " threads\n"
+            << std::setw(8) << "limbs" << std::setw(16) << "serial, us"
+            << std::setw(16) << "forked, us" << '\n';
+
+  size_t crossover = 0;
+  size_t previous = 0;
+  size_t wins = 0;
+  for (size_t part = from; part <= to; part *= 2) {
+    Operands operands =
+        MakeOperands(Operation::kMultiplication, 2 * part, generator);
+
+    thresholds.parallel_limbs = BigInteger::kUnlimited;
+    double serial = Measure(Operation::kMultiplication, operands);
+    thresholds.parallel_limbs = part;
+    double forked = Measure(Operation::kMultiplication, operands);
+
+    std::cout << std::setw(8) << 2 * part << std::setw(16) << serial
+              << std::setw(16) << forked << '\n';
+
+    wins = forked < serial ? wins + 1 : 0;
+    if (wins == 2 && crossover == 0) {
+      crossover = previous;
+    }
+    previous = part;
+  }
+
+  if (crossover == 0) {
+    crossover = to;
+  }
+
+  thresholds.parallel_limbs = crossover;
+  BigInteger::SetThreads(1);
+  std::cout << '\n';
+  return crossover;
+}
+
+// Prints the time of `operation` with the `baseline` thresholds next to the
+// time with the current ones, for sizes from `from` to `to` limbs.
+void Compare(const char* title, const char* baseline_name, Operation operation,
+             const BigIntegerThresholds& baseline, size_t from, size_t to,
+             size_t factor, std::mt19937_64& generator) {
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+  const BigIntegerThresholds tuned = thresholds;
+
+  std::cout << title << '\n'
+            << std::setw(8) << "limbs" << std::setw(16) << baseline_name
+            << std::setw(16) << "tuned, us" << '\n';
+
+  for (size_t limbs = from; limbs <= to; limbs *= factor) {
+    Operands operands = MakeOperands(operation, limbs, generator);
+
+    thresholds = baseline;
+    double slow = Measure(operation, operands);
+    thresholds = tuned;
+    double fast = Measure(operation, operands);
+
+    std::cout << std::setw(8) << limbs << std::setw(16) << slow
+              << std::setw(16) << fast << '\n';
+  }
+
+  std::cout << '\n';
+}
+
+// Microseconds per step of a sum of products of `limbs`-limb numbers, whose
+// temporaries come from `resource`, or from a monotonic arena that is
+// released after every batch of steps if `resource` is null.
+double MeasureSumOfProducts(size_t limbs, std::pmr::memory_resource* resource,
+                            std::mt19937_64& generator) {
+  using Clock = std::chrono::steady_clock;
+  const size_t steps = 1000;
+
+  std::vector<BigInteger> factors;
+  for (size_t i = 0; i < 16; ++i) {
+    factors.push_back(RandomInteger(limbs, generator));
+  }
+
+  double best = 0;
+  for (int run = 0; run < 5; ++run) {
+    auto start = Clock::now();
+    {
+      std::pmr::monotonic_buffer_resource arena;
+      BigIntegerMemoryScope scope(resource != nullptr ? resource : &arena);
+      BigInteger sum;
+      for (size_t i = 0; i < steps; ++i) {
+        BigInteger product = factors[i % 16] * factors[(i + 1) % 16];
+        sum += product - factors[(i + 2) % 16];
+      }
+      if (!sum) {
+        std::cerr << "unexpected zero result\n";
+      }
+    }
+
+    double average =
+        std::chrono::duration<double, std::micro>(Clock::now() - start)
+            .count() /
+        static_cast<double>(steps);
+    best = (run == 0) ? average : std::min(best, average);
+  }
+
+  return best;
+}
+
+}  // namespace
+
+// Tunes the thresholds one tier at a time, each on top of the tiers tuned
+// before it, then compares the tuned operations with the slower algorithms.
+int main() {
+  std::mt19937_64 generator(42);
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+  const BigIntegerThresholds defaults = thresholds;
+  const size_t unlimited = size_t{1} << 24;
+
+  std::cout << "Limb kernels: " << limb_kernels::Name() << "\n\n";
+
+  BigInteger::SetMaxLimbs(BigInteger::kUnlimited);
+  thresholds.toom3_limbs = unlimited;
+  thresholds.ntt_limbs = unlimited;
+  thresholds.division_limbs = unlimited;
+  thresholds.conversion_limbs = unlimited;
+  thresholds.parse_limbs = unlimited;
+  thresholds.gcd_limbs = unlimited;
+  FindCrossover("Karatsuba", &BigIntegerThresholds::karatsuba_limbs,
+                Operation::kMultiplication, 8, 128, 4, generator);
+  FindCrossover("Toom-3", &BigIntegerThresholds::toom3_limbs,
+                Operation::kMultiplication, 60, 600, 20, generator);
+  FindCrossover("NTT", &BigIntegerThresholds::ntt_limbs,
+                Operation::kMultiplication, 500, 8000, 500, generator);
+  FindCrossover("Recursive division", &BigIntegerThresholds::division_limbs,
+                Operation::kDivision, 10, 200, 10, generator);
+  FindCrossover("Recursive conversion", &BigIntegerThresholds::conversion_limbs,
+                Operation::kToString, 10, 200, 10, generator);
+  FindCrossover("Recursive parsing", &BigIntegerThresholds::parse_limbs,
+                Operation::kParse, 100, 2000, 100, generator);
+  FindCrossover("Half gcd", &BigIntegerThresholds::gcd_limbs,
+                Operation::kGcd, 100, 2000, 100, generator);
+
+  const BigIntegerThresholds tuned = thresholds;
+  std::cout << "Tuned thresholds (defaults in parentheses)\n"
+            << "  karatsuba_limbs = " << tuned.karatsuba_limbs << " ("
+            << defaults.karatsuba_limbs << ")\n"
+            << "  toom3_limbs = " << tuned.toom3_limbs << " ("
+            << defaults.toom3_limbs << ")\n"
+            << "  ntt_limbs = " << tuned.ntt_limbs << " ("
+            << defaults.ntt_limbs << ")\n"
+            << "  division_limbs = " << tuned.division_limbs << " ("
+            << defaults.division_limbs << ")\n"
+            << "  conversion_limbs = " << tuned.conversion_limbs << " ("
+            << defaults.conversion_limbs << ")\n"
+            << "  parse_limbs = " << tuned.parse_limbs << " ("
+            << defaults.parse_limbs << ")\n"
+            << "  gcd_limbs = " << tuned.gcd_limbs << " ("
+            << defaults.gcd_limbs << ")\n\n";
+
+  BigIntegerThresholds schoolbook = tuned;
+  schoolbook.karatsuba_limbs = unlimited;
+  schoolbook.toom3_limbs = unlimited;
+  schoolbook.ntt_limbs = unlimited;
+  Compare("Full multiplication", "schoolbook, us", Operation::kMultiplication,
+          schoolbook, 64, 4096, 2, generator);
+
+  BigIntegerThresholds toom3 = tuned;
+  toom3.ntt_limbs = unlimited;
+  Compare("Large multiplication", "toom-3, us", Operation::kMultiplication,
+          toom3, 8192, 65536, 2, generator);
+
+  // parallel_limbs is only tuned where there are cores to measure it on.
+  size_t threads = std::thread::hardware_concurrency();
+  if (threads > 1) {
+    size_t parallel_limbs =
+        FindParallelCrossover(threads, 256, 16384, generator);
+    std::cout << "Tuned parallel_limbs = " << parallel_limbs << " ("
+              << defaults.parallel_limbs << ")\n\n";
+
+    std::cout << "Multiplication on " << threads << " threads\n"
+              << std::setw(8) << "limbs" << std::setw(16) << "1 thread, us"
+              << std::setw(16) << "threads, us" << '\n';
+    for (size_t limbs = 4096; limbs <= 65536; limbs *= 2) {
+      Operands operands =
+          MakeOperands(Operation::kMultiplication, limbs, generator);
+
+      BigInteger::SetThreads(1);
+      double serial = Measure(Operation::kMultiplication, operands);
+      BigInteger::SetThreads(threads);
+      double parallel = Measure(Operation::kMultiplication, operands);
+
+      std::cout << std::setw(8) << limbs << std::setw(16) << serial
+                << std::setw(16) << parallel << '\n';
+    }
+    BigInteger::SetThreads(1);
+    std::cout << '\n';
+  }
+
+  BigIntegerThresholds basecase = tuned;
+  basecase.division_limbs = unlimited;
+  basecase.conversion_limbs = unlimited;
+  basecase.parse_limbs = unlimited;
+  Compare("Division of 2n by n limbs", "basecase, us", Operation::kDivision,
+          basecase, 256, 16384, 4, generator);
+  Compare("Decimal output", "basecase, us", Operation::kToString, basecase,
+          256, 16384, 4, generator);
+  Compare("Decimal parsing", "basecase, us", Operation::kParse, basecase, 256,
+          16384, 4, generator);
+
+  BigIntegerThresholds lehmer = tuned;
+  lehmer.gcd_limbs = unlimited;
+  Compare("Gcd", "lehmer, us", Operation::kGcd, lehmer, 256, 16384, 4,
+          generator);
+
+  std::cout << "Sum of products\n"
+            << std::setw(8) << "limbs" << std::setw(16) << "heap, us"
+            << std::setw(16) << "arena, us" << '\n';
+  for (size_t limbs = 4; limbs <= 256; limbs *= 4) {
+    double heap = MeasureSumOfProducts(
+        limbs, std::pmr::new_delete_resource(), generator);
+    double arena = MeasureSumOfProducts(limbs, nullptr, generator);
+    std::cout << std::setw(8) << limbs << std::setw(16) << heap
+              << std::setw(16) << arena << '\n';
+  }
+  std::cout << '\n';
+
+  return 0;
+}
@@ -1,362 +1,3348 @@
 #include "big_integer.h"
 
-BigInteger BigInteger::ChangeSignToZeroNumber(const BigInteger& integer) const {
-  bool all_zeros = false;
-  BigInteger temp = integer;
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "limb_kernels.h"
+#include "scratch_workspace.h"
+#include "thread_pool.h"
+
+namespace {
+
+using Limb = BigInteger::Limb;
+using limb_kernels::AddMultipliedLimbs;
+using limb_kernels::AddN;
+using limb_kernels::MultiplyLimbsBy;
+using limb_kernels::SubtractMultipliedLimbs;
+using limb_kernels::SubtractN;
+__extension__ typedef unsigned __int128 DoubleLimb;
+__extension__ typedef __int128 SignedDoubleLimb;
+
+// Smallest operands for which Toom-3 evaluation values are shorter than the
+// operands themselves.
+constexpr size_t kMinToom3Limbs = 12;
+
+int CompareMagnitude(const LimbVector& lhs, const LimbVector& rhs) {
+  if (lhs.size() != rhs.size()) {
+    return lhs.size() < rhs.size() ? -1 : 1;
+  }
+
+  for (size_t i = lhs.size(); i-- > 0;) {
+    if (lhs[i] != rhs[i]) {
+      return lhs[i] < rhs[i] ? -1 : 1;
+    }
+  }
+
+  return 0;
+}
+
+// lhs_size >= rhs_size.
+Limb AddLimbs(Limb* result, const Limb* lhs, size_t lhs_size, const Limb* rhs,
+              size_t rhs_size) {
+  Limb carry = AddN(result, lhs, rhs, rhs_size);
+  for (size_t i = rhs_size; i < lhs_size; ++i) {
+    result[i] = lhs[i] + carry;
+    carry = static_cast<Limb>(result[i] < carry);
+  }
+
+  return carry;
+}
+
+// Limbs of rhs past lhs_size are ignored.
+Limb SubtractLimbs(Limb* result, const Limb* lhs, size_t lhs_size,
+                   const Limb* rhs, size_t rhs_size) {
+  size_t common = std::min(lhs_size, rhs_size);
+  Limb borrow = SubtractN(result, lhs, rhs, common);
+  for (size_t i = common; i < lhs_size; ++i) {
+    Limb limb = lhs[i];
+    result[i] = limb - borrow;
+    borrow = static_cast<Limb>(limb < borrow);
+  }
+
+  return borrow;
+}
+
+size_t SignificantLimbs(const Limb* number, size_t size) {
+  while (size > 0 && number[size - 1] == 0) {
+    --size;
+  }
+
+  return size;
+}
+
+int CompareLimbs(const Limb* lhs, size_t lhs_size, const Limb* rhs,
+                 size_t rhs_size) {
+  lhs_size = SignificantLimbs(lhs, lhs_size);
+  rhs_size = SignificantLimbs(rhs, rhs_size);
+  if (lhs_size != rhs_size) {
+    return lhs_size < rhs_size ? -1 : 1;
+  }
+
+  for (size_t i = lhs_size; i-- > 0;) {
+    if (lhs[i] != rhs[i]) {
+      return lhs[i] < rhs[i] ? -1 : 1;
+    }
+  }
+
+  return 0;
+}
+
+void MultiplyBasecase(Limb* result, const Limb* lhs, size_t lhs_size,
+                      const Limb* rhs, size_t rhs_size) {
+  if (lhs_size == 0) {
+    std::fill(result, result + rhs_size, 0);
+    return;
+  }
+
+  result[rhs_size] = MultiplyLimbsBy(result, rhs, rhs_size, lhs[0]);
+  for (size_t i = 1; i < lhs_size; ++i) {
+    result[i + rhs_size] =
+        AddMultipliedLimbs(result + i, rhs, rhs_size, lhs[i]);
+  }
+}
+
+// Threads for BigInteger::SetThreads, and the pool that runs them. The pool
+// is replaced rather than resized, so operations in flight keep the one
+// they started with.
+std::atomic<size_t>& ThreadCount() {
+  static std::atomic<size_t> threads{1};
+  return threads;
+}
+
+std::mutex& PoolMutex() {
+  static std::mutex mutex;
+  return mutex;
+}
+
+std::shared_ptr<ThreadPool>& PoolSlot() {
+  static std::shared_ptr<ThreadPool> pool;
+  return pool;
+}
+
+std::shared_ptr<ThreadPool> CurrentPool() {
+  std::lock_guard<std::mutex> lock(PoolMutex());
+  return PoolSlot();
+}
+
+// Whether work split into parts of `part_limbs` limbs goes to the pool.
+bool Parallel(size_t part_limbs) {
+  return part_limbs >= BigInteger::Thresholds().parallel_limbs &&
+         ThreadCount() > 1;
+}
+
+// Calls task(0), ..., task(count - 1), on the pool if Parallel(part_limbs)
+// and in order on the calling thread otherwise.
+template <class Task>
+void ParallelFor(size_t part_limbs, size_t count, const Task& task) {
+  if (count > 1 && Parallel(part_limbs)) {
+    if (std::shared_ptr<ThreadPool> pool = CurrentPool()) {
+      std::vector<std::function<void()>> tasks;
+      tasks.reserve(count);
+      for (size_t i = 0; i < count; ++i) {
+        tasks.emplace_back([&task, i] { task(i); });
+      }
+      pool->Invoke(tasks.data(), count);
+      return;
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    task(i);
+  }
+}
+
+// Fork(part_limbs, a, b, ...) runs a(), b(), ... as ParallelFor does.
+template <class... Tasks>
+void Fork(size_t part_limbs, const Tasks&... tasks) {
+  if (Parallel(part_limbs)) {
+    if (std::shared_ptr<ThreadPool> pool = CurrentPool()) {
+      const std::function<void()> functions[] = {tasks...};
+      pool->Invoke(functions, sizeof...(Tasks));
+      return;
+    }
+  }
+
+  (tasks(), ...);
+}
+
+// Calls body(begin, end) on consecutive ranges that cover [0, size): one
+// per thread if Parallel(size), else the whole range at once.
+template <class Body>
+void ParallelRanges(size_t size, const Body& body) {
+  size_t ranges = Parallel(size) ? ThreadCount().load() : 1;
+  size_t length = (size + ranges - 1) / ranges;
+  ParallelFor(size, ranges, [&](size_t i) {
+    size_t begin = std::min(size, i * length);
+    body(begin, std::min(size, begin + length));
+  });
+}
+
+void MultiplyLimbs(Limb*, const Limb*, size_t, const Limb*, size_t);
+void SquareLimbs(Limb*, const Limb*, size_t);
+
+// Splits both operands at half of the longer one:
+// (a1 B^m + a0)(b1 B^m + b0) = a1 b1 B^2m + ((a0 + a1)(b0 + b1) - a0 b0 -
+// a1 b1) B^m + a0 b0. Requires lhs_size / 2 < rhs_size <= lhs_size.
+void MultiplyKaratsuba(Limb* result, const Limb* lhs, size_t lhs_size,
+                       const Limb* rhs, size_t rhs_size) {
+  size_t half = lhs_size / 2;
+  size_t lhs_high_size = lhs_size - half;
+  size_t rhs_high_size = rhs_size - half;
+
+  ScratchBuffer lhs_sum(lhs_high_size + 1);
+  lhs_sum.back() =
+      AddLimbs(lhs_sum.data(), lhs + half, lhs_high_size, lhs, half);
+
+  size_t rhs_sum_size = std::max(half, rhs_high_size);
+  ScratchBuffer rhs_sum(rhs_sum_size + 1);
+  if (rhs_high_size >= half) {
+    rhs_sum.back() =
+        AddLimbs(rhs_sum.data(), rhs + half, rhs_high_size, rhs, half);
+  } else {
+    rhs_sum.back() =
+        AddLimbs(rhs_sum.data(), rhs, half, rhs + half, rhs_high_size);
+  }
+
+  size_t middle_size = lhs_sum.size() + rhs_sum.size();
+  ScratchBuffer middle(middle_size);
+  Fork(
+      half, [&] { MultiplyLimbs(result, lhs, half, rhs, half); },
+      [&] {
+        MultiplyLimbs(result + 2 * half, lhs + half, lhs_high_size,
+                      rhs + half, rhs_high_size);
+      },
+      [&] {
+        MultiplyLimbs(middle.data(), lhs_sum.data(), lhs_sum.size(),
+                      rhs_sum.data(), rhs_sum.size());
+      });
+
+  SubtractLimbs(middle.data(), middle.data(), middle_size, result, 2 * half);
+  SubtractLimbs(middle.data(), middle.data(), middle_size, result + 2 * half,
+                lhs_high_size + rhs_high_size);
+
+  size_t total_size = lhs_size + rhs_size;
+  middle_size = SignificantLimbs(middle.data(), middle_size);
+  AddLimbs(result + half, result + half, total_size - half, middle.data(),
+           middle_size);
+}
+
+// Helpers for Toom-3 evaluation and interpolation. These operate on
+// fixed-width buffers holding two's complement values, so that signed
+// intermediate results need no separate sign handling.
+
+void LoadLimbs(Limb* destination, size_t width, const Limb* source,
+               size_t size) {
+  std::copy(source, source + size, destination);
+  std::fill(destination + size, destination + width, 0);
+}
+
+bool IsNegativeTwos(const Limb* number, size_t width) {
+  return (number[width - 1] >> 63) != 0;
+}
+
+void NegateTwos(Limb* number, size_t width) {
+  Limb carry = 1;
+  for (size_t i = 0; i < width; ++i) {
+    number[i] = ~number[i] + carry;
+    carry = static_cast<Limb>(carry != 0 && number[i] == 0);
+  }
+}
+
+void HalveTwos(Limb* number, size_t width) {
+  for (size_t i = 0; i + 1 < width; ++i) {
+    number[i] = (number[i] >> 1) | (number[i + 1] << 63);
+  }
+  number[width - 1] =
+      static_cast<Limb>(static_cast<int64_t>(number[width - 1]) >> 1);
+}
+
+// Exact division by 3 modulo B^width (Hensel division).
+void DivideExactBy3Twos(Limb* number, size_t width) {
+  constexpr Limb kInverse3 = 0xAAAAAAAAAAAAAAABULL;
+  Limb borrow = 0;
+
+  for (size_t i = 0; i < width; ++i) {
+    Limb limb = number[i];
+    Limb next_borrow = static_cast<Limb>(limb < borrow);
+    Limb quotient = (limb - borrow) * kInverse3;
+    number[i] = quotient;
+    borrow = static_cast<Limb>((static_cast<DoubleLimb>(quotient) * 3) >> 64) +
+             next_borrow;
+  }
+}
+
+// result (2 * width limbs) = lhs * rhs for width-limb two's complement inputs.
+// lhs == rhs squares.
+void MultiplyTwos(Limb* result, const Limb* lhs, const Limb* rhs,
+                  size_t width) {
+  bool square = lhs == rhs;
+  ScratchBuffer lhs_abs(width);
+  ScratchBuffer rhs_abs(square ? 0 : width);
+  std::copy(lhs, lhs + width, lhs_abs.data());
+  if (!square) {
+    std::copy(rhs, rhs + width, rhs_abs.data());
+  }
+
+  bool negative = false;
+  if (IsNegativeTwos(lhs, width)) {
+    NegateTwos(lhs_abs.data(), width);
+    negative = !negative;
+  }
+  if (!square && IsNegativeTwos(rhs, width)) {
+    NegateTwos(rhs_abs.data(), width);
+    negative = !negative;
+  }
+  negative = negative && !square;
+
+  const Limb* rhs_data = square ? lhs_abs.data() : rhs_abs.data();
+  size_t lhs_size = SignificantLimbs(lhs_abs.data(), width);
+  size_t rhs_size = SignificantLimbs(rhs_data, width);
+
+  std::fill(result, result + 2 * width, 0);
+  if (lhs_size == 0 || rhs_size == 0) {
+    return;
+  }
+
+  MultiplyLimbs(result, lhs_abs.data(), lhs_size, rhs_data, rhs_size);
+  if (negative) {
+    NegateTwos(result, 2 * width);
+  }
+}
+
+// Toom-3 with Bodrato's evaluation points 0, 1, -1, -2 and infinity. Both
+// operands are split into three parts of part_size limbs; requires
+// rhs_size > 2 * part_size. A square (lhs == rhs) is evaluated once and its
+// five pointwise products are squares.
+void MultiplyToom3(Limb* result, const Limb* lhs, size_t lhs_size,
+                   const Limb* rhs, size_t rhs_size, size_t part_size) {
+  const size_t k = part_size;
+  const size_t width = k + 2;
+  const size_t product_width = 2 * width;
+
+  const Limb* lhs_parts[3] = {lhs, lhs + k, lhs + 2 * k};
+  const Limb* rhs_parts[3] = {rhs, rhs + k, rhs + 2 * k};
+  const size_t lhs_high_size = lhs_size - 2 * k;
+  const size_t rhs_high_size = rhs_size - 2 * k;
+
+  // Values at 1, -1 and -2 for both operands.
+  ScratchBuffer values(6 * width);
+  auto evaluate = [&](const Limb* const* parts, size_t high_size,
+                      Limb* at_one, Limb* at_minus_one, Limb* at_minus_two) {
+    ScratchBuffer even(width);
+    ScratchBuffer part(width);
+
+    LoadLimbs(even.data(), width, parts[0], k);
+    LoadLimbs(part.data(), width, parts[2], high_size);
+    AddLimbs(even.data(), even.data(), width, part.data(), width);
+
+    LoadLimbs(part.data(), width, parts[1], k);
+    AddLimbs(at_one, even.data(), width, part.data(), width);
+    SubtractLimbs(at_minus_one, even.data(), width, part.data(), width);
+
+    LoadLimbs(part.data(), width, parts[2], high_size);
+    AddLimbs(at_minus_two, at_minus_one, width, part.data(), width);
+    AddLimbs(at_minus_two, at_minus_two, width, at_minus_two, width);
+    LoadLimbs(part.data(), width, parts[0], k);
+    SubtractLimbs(at_minus_two, at_minus_two, width, part.data(), width);
+  };
+
+  Limb* lhs_values = values.data();
+  Limb* rhs_values = lhs == rhs ? lhs_values : values.data() + 3 * width;
+  evaluate(lhs_parts, lhs_high_size, lhs_values, lhs_values + width,
+           lhs_values + 2 * width);
+  if (rhs_values != lhs_values) {
+    evaluate(rhs_parts, rhs_high_size, rhs_values, rhs_values + width,
+             rhs_values + 2 * width);
+  }
+
+  ScratchBuffer products(6 * product_width);
+  Limb* r1 = products.data();
+  Limb* r2 = r1 + product_width;
+  Limb* r3 = r2 + product_width;
+  Limb* at_zero = r3 + product_width;
+  Limb* at_infinity = at_zero + product_width;
+  Limb* temporary = at_infinity + product_width;
+
+  // r(0) and r(infinity) go straight into the result.
+  size_t total_size = lhs_size + rhs_size;
+  std::fill(result + 2 * k, result + 4 * k, 0);
+  Fork(
+      k, [&] { MultiplyLimbs(result, lhs_parts[0], k, rhs_parts[0], k); },
+      [&] {
+        MultiplyLimbs(result + 4 * k, lhs_parts[2], lhs_high_size,
+                      rhs_parts[2], rhs_high_size);
+      },
+      [&] { MultiplyTwos(r1, lhs_values, rhs_values, width); },
+      [&] {
+        MultiplyTwos(r2, lhs_values + width, rhs_values + width, width);
+      },
+      [&] {
+        MultiplyTwos(r3, lhs_values + 2 * width, rhs_values + 2 * width,
+                     width);
+      });
+  LoadLimbs(at_zero, product_width, result, 2 * k);
+  LoadLimbs(at_infinity, product_width, result + 4 * k,
+            lhs_high_size + rhs_high_size);
+
+  // r1 = r(1), r2 = r(-1), r3 = r(-2) on entry.
+  SubtractLimbs(r3, r3, product_width, r1, product_width);
+  DivideExactBy3Twos(r3, product_width);
+  SubtractLimbs(r1, r1, product_width, r2, product_width);
+  HalveTwos(r1, product_width);
+  SubtractLimbs(r2, r2, product_width, at_zero, product_width);
+  SubtractLimbs(r3, r2, product_width, r3, product_width);
+  HalveTwos(r3, product_width);
+  AddLimbs(temporary, at_infinity, product_width, at_infinity, product_width);
+  AddLimbs(r3, r3, product_width, temporary, product_width);
+  AddLimbs(r2, r2, product_width, r1, product_width);
+  SubtractLimbs(r2, r2, product_width, at_infinity, product_width);
+  SubtractLimbs(r1, r1, product_width, r3, product_width);
+
+  Limb* coefficients[3] = {r1, r2, r3};
+  for (size_t i = 0; i < 3; ++i) {
+    size_t offset = (i + 1) * k;
+    size_t size = SignificantLimbs(coefficients[i], product_width);
+    AddLimbs(result + offset, result + offset, total_size - offset,
+             coefficients[i], size);
+  }
+}
+
+// Arithmetic modulo one of the NTT primes. Values are kept in [0, p);
+// twiddle factors and constants are stored in Montgomery form (x * 2^64 mod
+// p), so that Multiply(x, constant) returns x * constant in normal form.
+class NttField {
+ public:
+  NttField(Limb modulus, Limb generator) : modulus_(modulus) {
+    Limb inverse = modulus;
+    for (int i = 0; i < 6; ++i) {
+      inverse *= 2 - modulus * inverse;
+    }
+    negated_inverse_ = ~inverse + 1;
+    generator_ = ToMontgomery(generator);
+  }
+
+  Limb Modulus() const { return modulus_; }
+
+  Limb ToMontgomery(Limb value) const {
+    return static_cast<Limb>((static_cast<DoubleLimb>(value % modulus_) << 64) %
+                             modulus_);
+  }
+
+  Limb Add(Limb lhs, Limb rhs) const {
+    Limb sum = lhs + rhs;
+    return sum >= modulus_ ? sum - modulus_ : sum;
+  }
+
+  Limb Subtract(Limb lhs, Limb rhs) const {
+    return lhs >= rhs ? lhs - rhs : lhs + modulus_ - rhs;
+  }
+
+  Limb Multiply(Limb lhs, Limb rhs) const {
+    DoubleLimb product = static_cast<DoubleLimb>(lhs) * rhs;
+    Limb factor = static_cast<Limb>(product) * negated_inverse_;
+    Limb reduced = static_cast<Limb>(
+        (product + static_cast<DoubleLimb>(factor) * modulus_) >> 64);
+    return reduced >= modulus_ ? reduced - modulus_ : reduced;
+  }
+
+  Limb Power(Limb base, Limb exponent) const {
+    Limb result = ToMontgomery(1);
+    while (exponent != 0) {
+      if ((exponent & 1) != 0) {
+        result = Multiply(result, base);
+      }
+      base = Multiply(base, base);
+      exponent >>= 1;
+    }
+    return result;
+  }
+
+  // Montgomery form of a primitive root of unity of the given power-of-two
+  // order, or of its inverse.
+  Limb RootOfUnity(size_t order, bool inverse) const {
+    Limb root = Power(generator_, (modulus_ - 1) / order);
+    return inverse ? Power(root, order - 1) : root;
+  }
+
+ private:
+  Limb modulus_;
+  Limb negated_inverse_;
+  Limb generator_;
+};
+
+// Primes c * 2^k + 1 below 2^63 with their primitive roots. Their product
+// exceeds 2^183, enough for the exact convolution of 2^55 limb products.
+constexpr Limb kNttModuli[3] = {4179340454199820289ULL,
+                                2485986994308513793ULL,
+                                1945555039024054273ULL};
+constexpr Limb kNttGenerators[3] = {3, 5, 5};
+
+// Powers of the size-th root of unity, or of its inverse, in Montgomery
+// form: max(size / 2, 1) of them.
+void NttTwiddles(Limb* twiddles, const NttField& field, size_t size,
+                 bool inverse) {
+  Limb root = field.RootOfUnity(size, inverse);
+  twiddles[0] = field.ToMontgomery(1);
+  for (size_t i = 1; i < size / 2; ++i) {
+    twiddles[i] = field.Multiply(twiddles[i - 1], root);
+  }
+}
+
+// Decimation in frequency: natural order in, bit-reversed order out. A
+// transform of a part of the input takes every stride-th twiddle. On the
+// pool the first stage runs in ranges, after which the two halves are
+// independent transforms of half the size.
+void NttForward(Limb* values, size_t size, const NttField& field,
+                const Limb* twiddles, size_t stride = 1) {
+  if (size >= 2 && Parallel(size / 2)) {
+    size_t half = size / 2;
+    ParallelRanges(half, [&](size_t begin, size_t end) {
+      for (size_t j = begin; j < end; ++j) {
+        Limb sum = field.Add(values[j], values[j + half]);
+        Limb difference = field.Subtract(values[j], values[j + half]);
+        values[j] = sum;
+        values[j + half] = field.Multiply(difference, twiddles[j * stride]);
+      }
+    });
+    Fork(
+        half,
+        [&] { NttForward(values, half, field, twiddles, 2 * stride); },
+        [&] { NttForward(values + half, half, field, twiddles, 2 * stride); });
+    return;
+  }
+
+  for (size_t length = size; length >= 2; length >>= 1, stride <<= 1) {
+    size_t half = length / 2;
+    for (size_t start = 0; start < size; start += length) {
+      Limb* low = values + start;
+      Limb* high = low + half;
+      for (size_t j = 0; j < half; ++j) {
+        Limb sum = field.Add(low[j], high[j]);
+        Limb difference = field.Subtract(low[j], high[j]);
+        low[j] = sum;
+        high[j] = field.Multiply(difference, twiddles[j * stride]);
+      }
+    }
+  }
+}
+
+// Decimation in time: bit-reversed order in, natural order out, scaled by
+// the transform size. Splits for the pool like NttForward, in reverse.
+void NttInverse(Limb* values, size_t size, const NttField& field,
+                const Limb* twiddles, size_t stride = 1) {
+  if (size >= 2 && Parallel(size / 2)) {
+    size_t half = size / 2;
+    Fork(
+        half,
+        [&] { NttInverse(values, half, field, twiddles, 2 * stride); },
+        [&] { NttInverse(values + half, half, field, twiddles, 2 * stride); });
+    ParallelRanges(half, [&](size_t begin, size_t end) {
+      for (size_t j = begin; j < end; ++j) {
+        Limb product = field.Multiply(values[j + half], twiddles[j * stride]);
+        values[j + half] = field.Subtract(values[j], product);
+        values[j] = field.Add(values[j], product);
+      }
+    });
+    return;
+  }
+
+  for (size_t length = 2, step = stride * size / 2; length <= size;
+       length <<= 1, step >>= 1) {
+    size_t half = length / 2;
+    for (size_t start = 0; start < size; start += length) {
+      Limb* low = values + start;
+      Limb* high = low + half;
+      for (size_t j = 0; j < half; ++j) {
+        Limb product = field.Multiply(high[j], twiddles[j * step]);
+        high[j] = field.Subtract(low[j], product);
+        low[j] = field.Add(low[j], product);
+      }
+    }
+  }
+}
+
+// Cyclic convolution of the operands modulo one prime, written to
+// residues[0, size). A square needs only one forward transform.
+void NttConvolution(Limb* residues, size_t size, const NttField& field,
+                    const Limb* lhs, size_t lhs_size, const Limb* rhs,
+                    size_t rhs_size) {
+  Limb modulus = field.Modulus();
+  bool square = lhs == rhs && lhs_size == rhs_size;
+
+  for (size_t i = 0; i < size; ++i) {
+    residues[i] = i < lhs_size ? lhs[i] % modulus : 0;
+  }
+
+  ScratchBuffer twiddles(std::max<size_t>(size / 2, 1));
+  NttTwiddles(twiddles.data(), field, size, false);
+  if (square) {
+    NttForward(residues, size, field, twiddles.data());
+    ParallelRanges(size, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        residues[i] = field.Multiply(residues[i], residues[i]);
+      }
+    });
+  } else {
+    ScratchBuffer other(size);
+    for (size_t i = 0; i < rhs_size; ++i) {
+      other[i] = rhs[i] % modulus;
+    }
+    Fork(
+        std::min(lhs_size, rhs_size),
+        [&] { NttForward(residues, size, field, twiddles.data()); },
+        [&] { NttForward(other.data(), size, field, twiddles.data()); });
+
+    ParallelRanges(size, [&](size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        residues[i] = field.Multiply(residues[i], other[i]);
+      }
+    });
+  }
+
+  NttTwiddles(twiddles.data(), field, size, true);
+  NttInverse(residues, size, field, twiddles.data());
+
+  // The pointwise products lost a factor 2^64, the inverse transform gained
+  // a factor of size: multiply by 2^64 / size in Montgomery form.
+  DoubleLimb size_inverse = 1;
+  for (Limb exponent = modulus - 2, base = size % modulus; exponent != 0;
+       exponent >>= 1) {
+    if ((exponent & 1) != 0) {
+      size_inverse = size_inverse * base % modulus;
+    }
+    base = static_cast<Limb>(static_cast<DoubleLimb>(base) * base % modulus);
+  }
+  Limb scale = field.ToMontgomery(field.ToMontgomery(
+      static_cast<Limb>(size_inverse)));
+
+  ParallelRanges(size, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      residues[i] = field.Multiply(residues[i], scale);
+    }
+  });
+}
+
+// Three-prime NTT multiplication with Garner's CRT recombination. Every
+// convolution coefficient is reconstructed exactly as a 3-limb integer.
+void MultiplyNtt(Limb* result, const Limb* lhs, size_t lhs_size,
+                 const Limb* rhs, size_t rhs_size) {
+  size_t total_size = lhs_size + rhs_size;
+  size_t size = 1;
+  while (size < total_size - 1) {
+    size <<= 1;
+  }
+
+  const NttField fields[3] = {NttField(kNttModuli[0], kNttGenerators[0]),
+                              NttField(kNttModuli[1], kNttGenerators[1]),
+                              NttField(kNttModuli[2], kNttGenerators[2])};
+
+  ScratchBuffer residues(3 * size);
+  ParallelFor(std::min(lhs_size, rhs_size), 3, [&](size_t i) {
+    NttConvolution(residues.data() + i * size, size, fields[i], lhs, lhs_size,
+                   rhs, rhs_size);
+  });
+
+  const Limb p1 = kNttModuli[0];
+  const Limb p2 = kNttModuli[1];
+  const Limb p3 = kNttModuli[2];
+
+  auto inverse_modulo = [](Limb value, const NttField& field) {
+    return field.Power(field.ToMontgomery(value), field.Modulus() - 2);
+  };
+
+  const Limb p1_inverse_mod_p2 = inverse_modulo(p1, fields[1]);
+  const Limb p1_mod_p3 = fields[2].ToMontgomery(p1);
+  const Limb p1p2_inverse_mod_p3 = inverse_modulo(
+      static_cast<Limb>(static_cast<DoubleLimb>(p1 % p3) * (p2 % p3) % p3),
+      fields[2]);
+  const DoubleLimb p1p2 = static_cast<DoubleLimb>(p1) * p2;
+
+  Limb carry[3] = {0, 0, 0};
+  for (size_t i = 0; i < total_size; ++i) {
+    Limb value[3] = {0, 0, 0};
+
+    if (i + 1 < total_size) {
+      Limb r1 = residues[i];
+      Limb r2 = residues[size + i];
+      Limb r3 = residues[2 * size + i];
+
+      Limb v2 = fields[1].Multiply(fields[1].Subtract(r2, r1 % p2),
+                                   p1_inverse_mod_p2);
+      Limb v3 = fields[2].Subtract(r3, r1 % p3);
+      v3 = fields[2].Subtract(v3, fields[2].Multiply(v2 % p3, p1_mod_p3));
+      v3 = fields[2].Multiply(v3, p1p2_inverse_mod_p3);
+
+      // value = r1 + p1 * v2 + p1 * p2 * v3, where p1 * p2 = high 2^64 + low.
+      DoubleLimb first = static_cast<DoubleLimb>(p1) * v2 + r1;
+      DoubleLimb second =
+          static_cast<DoubleLimb>(static_cast<Limb>(p1p2)) * v3;
+      DoubleLimb third =
+          static_cast<DoubleLimb>(static_cast<Limb>(p1p2 >> 64)) * v3;
+
+      DoubleLimb sum = static_cast<DoubleLimb>(static_cast<Limb>(first)) +
+                       static_cast<Limb>(second);
+      value[0] = static_cast<Limb>(sum);
+      sum = (sum >> 64) + (first >> 64) + (second >> 64) +
+            static_cast<Limb>(third);
+      value[1] = static_cast<Limb>(sum);
+      value[2] = static_cast<Limb>((sum >> 64) + (third >> 64));
+    }
+
+    Limb add_carry = 0;
+    for (size_t j = 0; j < 3; ++j) {
+      Limb sum = value[j] + add_carry;
+      add_carry = static_cast<Limb>(sum < add_carry);
+      sum += carry[j];
+      add_carry += static_cast<Limb>(sum < carry[j]);
+      value[j] = sum;
+    }
+
+    result[i] = value[0];
+    carry[0] = value[1];
+    carry[1] = value[2];
+    carry[2] = add_carry;
+  }
+}
+
+// Writes lhs * rhs into result[0, lhs_size + rhs_size). The result must not
+// overlap the operands. Equal operands are squared.
+void MultiplyLimbs(Limb* result, const Limb* lhs, size_t lhs_size,
+                   const Limb* rhs, size_t rhs_size) {
+  if (lhs == rhs && lhs_size == rhs_size) {
+    SquareLimbs(result, lhs, lhs_size);
+    return;
+  }
+
+  if (lhs_size < rhs_size) {
+    std::swap(lhs, rhs);
+    std::swap(lhs_size, rhs_size);
+  }
+
+  // Below four limbs the Karatsuba middle product is no smaller than the
+  // original one.
+  size_t karatsuba_limbs =
+      std::max<size_t>(BigInteger::Thresholds().karatsuba_limbs, 4);
+  if (rhs_size < karatsuba_limbs) {
+    MultiplyBasecase(result, lhs, lhs_size, rhs, rhs_size);
+    return;
+  }
+
+  if (rhs_size >= std::max<size_t>(BigInteger::Thresholds().ntt_limbs, 1)) {
+    MultiplyNtt(result, lhs, lhs_size, rhs, rhs_size);
+    return;
+  }
+
+  size_t toom3_limbs = std::max<size_t>(BigInteger::Thresholds().toom3_limbs,
+                                        kMinToom3Limbs);
+  size_t toom3_part_size = (lhs_size + 2) / 3;
+  if (rhs_size >= toom3_limbs && rhs_size > 2 * toom3_part_size) {
+    MultiplyToom3(result, lhs, lhs_size, rhs, rhs_size, toom3_part_size);
+    return;
+  }
+
+  if (2 * rhs_size > lhs_size) {
+    MultiplyKaratsuba(result, lhs, lhs_size, rhs, rhs_size);
+    return;
+  }
+
+  // Unbalanced operands: multiply rhs by lhs_size / rhs_size slices of lhs.
+  size_t total_size = lhs_size + rhs_size;
+  std::fill(result, result + total_size, 0);
+  if (Parallel(rhs_size)) {
+    // The products of every other slice do not overlap, so the even ones go
+    // straight into the result and the odd ones into a second buffer.
+    ScratchBuffer odd(total_size);
+    size_t slices = (lhs_size + rhs_size - 1) / rhs_size;
+    ParallelFor(rhs_size, slices, [&](size_t i) {
+      size_t offset = i * rhs_size;
+      size_t slice_size = std::min(rhs_size, lhs_size - offset);
+      Limb* target = (i % 2 == 0 ? result : odd.data()) + offset;
+      MultiplyLimbs(target, lhs + offset, slice_size, rhs, rhs_size);
+    });
+    AddLimbs(result, result, total_size, odd.data(), total_size);
+    return;
+  }
+
+  ScratchBuffer partial(2 * rhs_size);
+
+  for (size_t offset = 0; offset < lhs_size; offset += rhs_size) {
+    size_t slice_size = std::min(rhs_size, lhs_size - offset);
+    MultiplyLimbs(partial.data(), lhs + offset, slice_size, rhs, rhs_size);
+    AddLimbs(result + offset, result + offset, total_size - offset,
+             partial.data(), slice_size + rhs_size);
+  }
+}
+
+LimbVector AddMagnitude(const LimbVector& lhs, const LimbVector& rhs) {
+  const LimbVector& longer = lhs.size() >= rhs.size() ? lhs : rhs;
+  const LimbVector& shorter = lhs.size() >= rhs.size() ? rhs : lhs;
+
+  LimbVector result(longer.size() + 1);
+  result.back() = AddLimbs(result.data(), longer.data(), longer.size(),
+                           shorter.data(), shorter.size());
+  return result;
+}
+
+// Requires |lhs| >= |rhs|.
+LimbVector SubtractMagnitude(const LimbVector& lhs,
+                             const LimbVector& rhs) {
+  LimbVector result(lhs.size());
+  SubtractLimbs(result.data(), lhs.data(), lhs.size(), rhs.data(), rhs.size());
+  return result;
+}
+
+LimbVector MultiplyMagnitude(const LimbVector& lhs,
+                             const LimbVector& rhs) {
+  if (lhs.empty() || rhs.empty()) {
+    return {};
+  }
+
+  LimbVector result(lhs.size() + rhs.size());
+  MultiplyLimbs(result.data(), lhs.data(), lhs.size(), rhs.data(),
+                rhs.size());
+  return result;
+}
+
+Limb ShiftLeftLimbs(Limb* result, const Limb* number, size_t size,
+                    unsigned shift) {
+  if (shift == 0) {
+    std::copy(number, number + size, result);
+    return 0;
+  }
+
+  Limb carry = 0;
+  for (size_t i = 0; i < size; ++i) {
+    Limb limb = number[i];
+    result[i] = (limb << shift) | carry;
+    carry = limb >> (64 - shift);
+  }
+
+  return carry;
+}
+
+void ShiftRightLimbs(Limb* result, const Limb* number, size_t size,
+                     unsigned shift) {
+  if (shift == 0) {
+    std::copy(number, number + size, result);
+    return;
+  }
+
+  for (size_t i = 0; i + 1 < size; ++i) {
+    result[i] = (number[i] >> shift) | (number[i + 1] << (64 - shift));
+  }
+  result[size - 1] = number[size - 1] >> shift;
+}
+
+// Each product number[i] number[j] with i < j is computed once and doubled,
+// then the squares on the diagonal are added: about half the limb products
+// of MultiplyBasecase.
+void SquareBasecase(Limb* result, const Limb* number, size_t size) {
+  std::fill(result, result + 2 * size, 0);
+
+  for (size_t i = 0; i + 1 < size; ++i) {
+    result[i + size] = AddMultipliedLimbs(result + 2 * i + 1, number + i + 1,
+                                          size - i - 1, number[i]);
+  }
+  result[2 * size - 1] = ShiftLeftLimbs(result, result, 2 * size - 1, 1);
+
+  Limb carry = 0;
+  for (size_t i = 0; i < size; ++i) {
+    DoubleLimb square = static_cast<DoubleLimb>(number[i]) * number[i];
+    DoubleLimb low = static_cast<DoubleLimb>(result[2 * i]) +
+                     static_cast<Limb>(square) + carry;
+    result[2 * i] = static_cast<Limb>(low);
+    DoubleLimb high = static_cast<DoubleLimb>(result[2 * i + 1]) +
+                      static_cast<Limb>(square >> 64) +
+                      static_cast<Limb>(low >> 64);
+    result[2 * i + 1] = static_cast<Limb>(high);
+    carry = static_cast<Limb>(high >> 64);
+  }
+}
+
+// (a1 B^m + a0)^2 = a1^2 B^2m + (a1^2 + a0^2 - (a1 - a0)^2) B^m + a0^2: three
+// half-size squares, and the difference needs no carry limb.
+void SquareKaratsuba(Limb* result, const Limb* number, size_t size) {
+  size_t half = size / 2;
+  size_t high_size = size - half;
+  const Limb* high = number + half;
+
+  ScratchBuffer difference(high_size);
+  if (CompareLimbs(high, high_size, number, half) >= 0) {
+    SubtractLimbs(difference.data(), high, high_size, number, half);
+  } else {
+    // The high part is the smaller one, so its limbs past `half` are zero.
+    SubtractLimbs(difference.data(), number, half, high, half);
+  }
+  size_t difference_size = SignificantLimbs(difference.data(), high_size);
+
+  ScratchBuffer square(2 * difference_size);
+  Fork(
+      half, [&] { SquareLimbs(result, number, half); },
+      [&] { SquareLimbs(result + 2 * half, high, high_size); },
+      [&] {
+        if (difference_size > 0) {
+          SquareLimbs(square.data(), difference.data(), difference_size);
+        }
+      });
+
+  ScratchBuffer middle(2 * high_size + 1);
+  middle.back() = AddLimbs(middle.data(), result + 2 * half, 2 * high_size,
+                           result, 2 * half);
+  SubtractLimbs(middle.data(), middle.data(), middle.size(), square.data(),
+                square.size());
+
+  size_t middle_size = SignificantLimbs(middle.data(), middle.size());
+  AddLimbs(result + half, result + half, 2 * size - half, middle.data(),
+           middle_size);
+}
+
+// Writes number^2 into result[0, 2 size) with the tiers of MultiplyLimbs.
+// The result must not overlap the operand.
+void SquareLimbs(Limb* result, const Limb* number, size_t size) {
+  size_t karatsuba_limbs =
+      std::max<size_t>(BigInteger::Thresholds().karatsuba_limbs, 4);
+  if (size < karatsuba_limbs) {
+    SquareBasecase(result, number, size);
+    return;
+  }
+
+  if (size >= std::max<size_t>(BigInteger::Thresholds().ntt_limbs, 1)) {
+    MultiplyNtt(result, number, size, number, size);
+    return;
+  }
+
+  size_t toom3_limbs = std::max<size_t>(BigInteger::Thresholds().toom3_limbs,
+                                        kMinToom3Limbs);
+  size_t toom3_part_size = (size + 2) / 3;
+  if (size >= toom3_limbs && size > 2 * toom3_part_size) {
+    MultiplyToom3(result, number, size, number, size, toom3_part_size);
+    return;
+  }
+
+  SquareKaratsuba(result, number, size);
+}
+
+// Knuth, TAOCP vol. 2, 4.3.1, Algorithm D. Writes dividend_size -
+// divisor_size + 1 quotient limbs and divisor_size remainder limbs. Requires
+// dividend_size >= divisor_size and a nonzero top limb of the divisor.
+void DivideBasecase(Limb* quotient, Limb* remainder, const Limb* dividend,
+                    size_t dividend_size, const Limb* divisor,
+                    size_t divisor_size) {
+  if (divisor_size == 1) {
+    DoubleLimb current_remainder = 0;
+    for (size_t i = dividend_size; i-- > 0;) {
+      DoubleLimb current = (current_remainder << 64) | dividend[i];
+      quotient[i] = static_cast<Limb>(current / divisor[0]);
+      current_remainder = current % divisor[0];
+    }
+    remainder[0] = static_cast<Limb>(current_remainder);
+    return;
+  }
+
+  // Normalize so that the top bit of the divisor is set; then every
+  // quotient digit estimate is at most two too large.
+  unsigned shift =
+      static_cast<unsigned>(__builtin_clzll(divisor[divisor_size - 1]));
+  ScratchBuffer numerator(dividend_size + 1);
+  ScratchBuffer denominator(divisor_size);
+  ShiftLeftLimbs(denominator.data(), divisor, divisor_size, shift);
+  numerator[dividend_size] =
+      ShiftLeftLimbs(numerator.data(), dividend, dividend_size, shift);
+
+  const Limb top = denominator[divisor_size - 1];
+  const Limb next = denominator[divisor_size - 2];
+
+  for (size_t j = dividend_size - divisor_size + 1; j-- > 0;) {
+    Limb* window = numerator.data() + j;
+    DoubleLimb estimate_numerator =
+        (static_cast<DoubleLimb>(window[divisor_size]) << 64) |
+        window[divisor_size - 1];
+
+    Limb estimate = 0;
+    DoubleLimb estimate_remainder = 0;
+    if (window[divisor_size] >= top) {
+      estimate = ~Limb{0};
+      estimate_remainder =
+          estimate_numerator - static_cast<DoubleLimb>(estimate) * top;
+    } else {
+      estimate = static_cast<Limb>(estimate_numerator / top);
+      estimate_remainder = estimate_numerator % top;
+    }
+
+    while ((estimate_remainder >> 64) == 0 &&
+           static_cast<DoubleLimb>(estimate) * next >
+               ((estimate_remainder << 64) | window[divisor_size - 2])) {
+      --estimate;
+      estimate_remainder += top;
+    }
+
+    Limb borrow = SubtractMultipliedLimbs(window, denominator.data(),
+                                          divisor_size, estimate);
+    Limb high = window[divisor_size];
+    window[divisor_size] = high - borrow;
+
+    if (high < borrow) {
+      --estimate;
+      window[divisor_size] += AddLimbs(window, window, divisor_size,
+                                       denominator.data(), divisor_size);
+    }
+
+    quotient[j] = estimate;
+  }
+
+  ShiftRightLimbs(remainder, numerator.data(), divisor_size, shift);
+}
+
+void DecrementLimbs(Limb* number, size_t size) {
+  const Limb one = 1;
+  SubtractLimbs(number, number, size, &one, 1);
+}
+
+// Recursive division (Brent and Zimmermann, Modern Computer Arithmetic,
+// Algorithm 1.8), the Burnikel-Ziegler scheme. Divides dividend_size = n + m
+// limbs by a normalized n-limb divisor with m <= n. Writes m + 1 quotient
+// limbs, the top one being at most 1, and n remainder limbs.
+void DivideBalanced(Limb* quotient, Limb* remainder, const Limb* dividend,
+                    size_t dividend_size, const Limb* divisor, size_t n) {
+  size_t m = dividend_size - n;
+
+  if (m < std::max<size_t>(BigInteger::Thresholds().division_limbs, 2)) {
+    DivideBasecase(quotient, remainder, dividend, dividend_size, divisor, n);
+    return;
+  }
+
+  // Divisor = high B^k + low. Each quotient half comes from dividing by
+  // `high` alone and is then corrected by subtracting low * q.
+  size_t k = m / 2;
+  const Limb* divisor_high = divisor + k;
+  size_t high_size = n - k;
+
+  ScratchBuffer quotient_high(m - k + 1);
+  ScratchBuffer partial_remainder(high_size);
+  DivideBalanced(quotient_high.data(), partial_remainder.data(),
+                 dividend + 2 * k, dividend_size - 2 * k, divisor_high,
+                 high_size);
+
+  ScratchBuffer current(n + k + 1);
+  std::copy(dividend, dividend + 2 * k, current.begin());
+  std::copy(partial_remainder.begin(), partial_remainder.end(),
+            current.begin() + 2 * k);
+
+  ScratchBuffer correction(m + 1);
+  MultiplyLimbs(correction.data(), quotient_high.data(), m - k + 1, divisor,
+                k);
+  while (CompareLimbs(current.data() + k, n + 1, correction.data(), m + 1) <
+         0) {
+    AddLimbs(current.data() + k, current.data() + k, n + 1, divisor, n);
+    DecrementLimbs(quotient_high.data(), m - k + 1);
+  }
+  SubtractLimbs(current.data() + k, current.data() + k, n + 1,
+                correction.data(), m + 1);
+
+  ScratchBuffer quotient_low(k + 1);
+  DivideBalanced(quotient_low.data(), partial_remainder.data(),
+                 current.data() + k, n, divisor_high, high_size);
+
+  ScratchBuffer last(n + 1);
+  std::copy(current.begin(), current.begin() + k, last.begin());
+  std::copy(partial_remainder.begin(), partial_remainder.end(),
+            last.begin() + k);
+
+  MultiplyLimbs(correction.data(), quotient_low.data(), k + 1, divisor, k);
+  while (CompareLimbs(last.data(), n + 1, correction.data(), 2 * k + 1) < 0) {
+    AddLimbs(last.data(), last.data(), n + 1, divisor, n);
+    DecrementLimbs(quotient_low.data(), k + 1);
+  }
+  SubtractLimbs(last.data(), last.data(), n + 1, correction.data(),
+                2 * k + 1);
+  std::copy(last.begin(), last.begin() + n, remainder);
+
+  std::copy(quotient_low.begin(), quotient_low.end(), quotient);
+  std::fill(quotient + k + 1, quotient + m + 1, 0);
+  AddLimbs(quotient + k, quotient + k, m - k + 1, quotient_high.data(),
+           m - k + 1);
+}
+
+// Writes dividend_size - divisor_size + 1 quotient limbs and divisor_size
+// remainder limbs, like DivideBasecase, choosing the algorithm by size.
+void DivideLimbs(Limb* quotient, Limb* remainder, const Limb* dividend,
+                 size_t dividend_size, const Limb* divisor,
+                 size_t divisor_size) {
+  size_t threshold = BigInteger::Thresholds().division_limbs;
+  if (divisor_size < threshold || dividend_size - divisor_size < threshold) {
+    DivideBasecase(quotient, remainder, dividend, dividend_size, divisor,
+                   divisor_size);
+    return;
+  }
+
+  const size_t n = divisor_size;
+  unsigned shift =
+      static_cast<unsigned>(__builtin_clzll(divisor[divisor_size - 1]));
+
+  ScratchBuffer normalized_divisor(n);
+  ShiftLeftLimbs(normalized_divisor.data(), divisor, n, shift);
+
+  // The extra top limb keeps the shifted dividend below divisor * B^m, so
+  // every quotient block below fits in its m limbs.
+  size_t work_size = dividend_size + 1;
+  ScratchBuffer work(work_size);
+  work[dividend_size] =
+      ShiftLeftLimbs(work.data(), dividend, dividend_size, shift);
+
+  // Peel off n quotient limbs at a time until the rest is balanced.
+  ScratchBuffer block_quotient(n + 1);
+  ScratchBuffer partial_remainder(n);
+  size_t m = work_size - n;
+  while (m > n) {
+    size_t offset = m - n;
+    DivideBalanced(block_quotient.data(), partial_remainder.data(),
+                   work.data() + offset, 2 * n, normalized_divisor.data(), n);
+    std::copy(block_quotient.begin(), block_quotient.begin() + n,
+              quotient + offset);
+    std::copy(partial_remainder.begin(), partial_remainder.end(),
+              work.begin() + offset);
+    m = offset;
+  }
+
+  DivideBalanced(block_quotient.data(), partial_remainder.data(), work.data(),
+                 n + m, normalized_divisor.data(), n);
+  std::copy(block_quotient.begin(), block_quotient.begin() + m, quotient);
+  ShiftRightLimbs(remainder, partial_remainder.data(), n, shift);
+}
+
+// -1 / limb mod B for an odd limb. The start value is correct to 3 bits and
+// every Newton step doubles that.
+Limb NegativeInverse(Limb limb) {
+  Limb inverse = limb;
+  for (int i = 0; i < 5; ++i) {
+    inverse *= 2 - limb * inverse;
+  }
+  return 0 - inverse;
+}
+
+// Montgomery reduction (REDC) modulo an odd n-limb m with R = B^n and
+// inverse = -1 / m mod B. Writes number / R mod m to result[0, n).
+// number[0, 2n) must be less than m R and is overwritten; result may not
+// overlap it.
+void MontgomeryReduce(Limb* result, Limb* number, const Limb* modulus,
+                      size_t n, Limb inverse) {
+  // Each step clears number[i] by adding a multiple of m and parks its carry
+  // in the freed limb; the carries are added to the high half at the end.
+  for (size_t i = 0; i < n; ++i) {
+    number[i] = AddMultipliedLimbs(number + i, modulus, n, number[i] * inverse);
+  }
+
+  Limb carry = AddLimbs(result, number + n, n, number, n);
+  if (carry != 0 || CompareLimbs(result, n, modulus, n) >= 0) {
+    SubtractLimbs(result, result, n, modulus, n);
+  }
+}
+
+// Barrett reduction (Handbook of Applied Cryptography, Algorithm 14.42)
+// modulo an n-limb m with reciprocal = floor(B^2n / m) in n + 2 limbs.
+// Writes number mod m to result[0, n) for number[0, 2n). Uses 5n + 5
+// scratch limbs.
+void BarrettReduce(Limb* result, const Limb* number, const Limb* modulus,
+                   size_t n, const Limb* reciprocal, Limb* scratch) {
+  const Limb* high = number + n - 1;
+  Limb* estimate = scratch;
+  Limb* product = estimate + 2 * n + 3;
+  Limb* remainder = product + 2 * n + 1;
+  const Limb* quotient = estimate + n + 1;
+
+  // The quotient estimate floor(floor(x / B^(n-1)) mu / B^(n+1)) and the
+  // low n + 1 limbs of its product with m. Short products skip the partial
+  // products below B^(n-1), which change the estimate by at most one, and
+  // those above B^(n+1), which do not matter. At half the work of a
+  // basecase product they beat Karatsuba up to about four times its
+  // threshold.
+  if (n < 4 * BigInteger::Thresholds().karatsuba_limbs) {
+    std::fill(estimate, estimate + 2 * n + 3, 0);
+    for (size_t i = 0; i <= n; ++i) {
+      size_t skip = n - 1 > i ? n - 1 - i : 0;
+      estimate[i + n + 2] = AddMultipliedLimbs(
+          estimate + i + skip, reciprocal + skip, n + 2 - skip, high[i]);
+    }
+
+    std::fill(product, product + n + 1, 0);
+    product[n] = AddMultipliedLimbs(product, modulus, n, quotient[0]);
+    for (size_t i = 1; i <= n; ++i) {
+      AddMultipliedLimbs(product + i, modulus, n + 1 - i, quotient[i]);
+    }
+  } else {
+    MultiplyLimbs(estimate, high, n + 1, reciprocal, n + 2);
+    MultiplyLimbs(product, quotient, n + 1, modulus, n);
+  }
+
+  // The estimate is at most three too small, so the remainder fits in
+  // n + 1 limbs.
+  SubtractLimbs(remainder, number, n + 1, product, n + 1);
+  while (CompareLimbs(remainder, n + 1, modulus, n) >= 0) {
+    SubtractLimbs(remainder, remainder, n + 1, modulus, n);
+  }
+  std::copy(remainder, remainder + n, result);
+}
+
+// Left-to-right sliding-window exponentiation (Menezes, van Oorschot and
+// Vanstone, Handbook of Applied Cryptography, Algorithm 14.85).
+// `multiply(target, factor)` sets target to target * factor and must accept
+// target == factor.
+template <class Element, class Multiply>
+Element PowSlidingWindow(const Element& base, const LimbVector& exponent,
+                         const Element& one, Multiply multiply) {
+  if (exponent.empty()) {
+    return one;
+  }
+
+  size_t bits = exponent.size() * 64 -
+                static_cast<size_t>(__builtin_clzll(exponent.back()));
+  auto bit = [&exponent](size_t index) {
+    return (exponent[index / 64] >> (index % 64)) & 1;
+  };
+
+  // Window widths that minimize squarings plus table multiplications.
+  size_t window = bits > 671 ? 6 : bits > 239 ? 5 : bits > 79 ? 4
+                : bits > 23  ? 3 : bits > 6   ? 2 : 1;
+
+  // Odd powers base^1, base^3, ..., base^(2^window - 1).
+  std::vector<Element> powers(size_t{1} << (window - 1), base);
+  if (powers.size() > 1) {
+    Element square = base;
+    multiply(square, base);
+    for (size_t i = 1; i < powers.size(); ++i) {
+      powers[i] = powers[i - 1];
+      multiply(powers[i], square);
+    }
+  }
+
+  // The leading window starts the result, so it is never squared while it
+  // is still one.
+  Element result = one;
+  bool started = false;
+  size_t high = bits;
+  while (high > 0) {
+    if (bit(high - 1) == 0) {
+      multiply(result, result);
+      --high;
+      continue;
+    }
+
+    size_t low = high > window ? high - window : 0;
+    while (bit(low) == 0) {
+      ++low;
+    }
+
+    size_t value = 0;
+    for (size_t i = high; i-- > low;) {
+      value = 2 * value + bit(i);
+    }
+
+    if (started) {
+      for (size_t i = low; i < high; ++i) {
+        multiply(result, result);
+      }
+      multiply(result, powers[value / 2]);
+    } else {
+      result = powers[value / 2];
+      started = true;
+    }
+    high = low;
+  }
+
+  return result;
+}
+
+// Greatest common divisor. Every reduction below replaces (a, b) by
+// M^-1 (a, b) for an integer matrix M of determinant 1, so the gcd is kept
+// exactly whatever M is; the conditions on M only make sure that the new
+// values stay nonnegative and shrink.
+
+void TrimLimbs(LimbVector& number) {
+  while (!number.empty() && number.back() == 0) {
+    number.pop_back();
+  }
+}
+
+size_t BitLengthOf(const LimbVector& number) {
+  if (number.empty()) {
+    return 0;
+  }
+  return number.size() * 64 -
+         static_cast<size_t>(__builtin_clzll(number.back()));
+}
+
+LimbVector Sum(const LimbVector& lhs, const LimbVector& rhs) {
+  LimbVector result = AddMagnitude(lhs, rhs);
+  TrimLimbs(result);
+  return result;
+}
+
+// Requires lhs >= rhs.
+LimbVector Difference(const LimbVector& lhs, const LimbVector& rhs) {
+  LimbVector result = SubtractMagnitude(lhs, rhs);
+  TrimLimbs(result);
+  return result;
+}
+
+LimbVector Product(const LimbVector& lhs, const LimbVector& rhs) {
+  LimbVector result = MultiplyMagnitude(lhs, rhs);
+  TrimLimbs(result);
+  return result;
+}
+
+// Quotient and remainder of nonnegative numbers; the divisor is nonzero.
+std::pair<LimbVector, LimbVector> DivideMagnitude(const LimbVector& dividend,
+                                                  const LimbVector& divisor) {
+  if (CompareMagnitude(dividend, divisor) < 0) {
+    return {LimbVector(), dividend};
+  }
+
+  LimbVector quotient(dividend.size() - divisor.size() + 1);
+  LimbVector remainder(divisor.size());
+  DivideLimbs(quotient.data(), remainder.data(), dividend.data(),
+              dividend.size(), divisor.data(), divisor.size());
+  TrimLimbs(quotient);
+  TrimLimbs(remainder);
+  return {std::move(quotient), std::move(remainder)};
+}
+
+// floor(number / B^p) and number mod B^p.
+LimbVector HighLimbs(const LimbVector& number, size_t p) {
+  return number.size() > p ? LimbVector(number.begin() + p, number.end())
+                           : LimbVector();
+}
+
+LimbVector LimbsBelow(const LimbVector& number, size_t p) {
+  LimbVector result(number.begin(),
+                    number.begin() + std::min(p, number.size()));
+  TrimLimbs(result);
+  return result;
+}
+
+// floor(number / 2^shift) and number 2^shift.
+LimbVector ShiftedRight(const LimbVector& number, size_t shift) {
+  size_t limbs = shift / 64;
+  if (limbs >= number.size()) {
+    return {};
+  }
+
+  LimbVector result(number.size() - limbs);
+  ShiftRightLimbs(result.data(), number.data() + limbs, result.size(),
+                  shift % 64);
+  TrimLimbs(result);
+  return result;
+}
+
+LimbVector ShiftedLeft(const LimbVector& number, size_t shift) {
+  if (number.empty()) {
+    return {};
+  }
+
+  size_t limbs = shift / 64;
+  LimbVector result(limbs + number.size() + 1);
+  result.back() = ShiftLeftLimbs(result.data() + limbs, number.data(),
+                                 number.size(), shift % 64);
+  TrimLimbs(result);
+  return result;
+}
+
+// Whether any of the lowest `shift` bits of number is set.
+bool HasLowBits(const LimbVector& number, size_t shift) {
+  size_t limbs = std::min(shift / 64, number.size());
+  for (size_t i = 0; i < limbs; ++i) {
+    if (number[i] != 0) {
+      return true;
+    }
+  }
+
+  unsigned bits = shift % 64;
+  return limbs < number.size() && bits != 0 &&
+         (number[limbs] << (64 - bits)) != 0;
+}
+
+// number mod divisor for a nonzero one-limb divisor.
+Limb RemainderSmall(const LimbVector& number, Limb divisor) {
+  DoubleLimb remainder = 0;
+  for (size_t i = number.size(); i-- > 0;) {
+    remainder = ((remainder << 64) | number[i]) % divisor;
+  }
+  return static_cast<Limb>(remainder);
+}
+
+// Binary gcd (Stein's algorithm) of numbers below 2^128.
+DoubleLimb BinaryGcd(DoubleLimb lhs, DoubleLimb rhs) {
+  auto trailing_zeros = [](DoubleLimb value) {
+    Limb low = static_cast<Limb>(value);
+    return low != 0 ? __builtin_ctzll(low)
+                    : 64 + __builtin_ctzll(static_cast<Limb>(value >> 64));
+  };
+
+  if (lhs == 0 || rhs == 0) {
+    return lhs | rhs;
+  }
+
+  int shift = trailing_zeros(lhs | rhs);
+  lhs >>= trailing_zeros(lhs);
+  while (rhs != 0) {
+    rhs >>= trailing_zeros(rhs);
+    if (lhs > rhs) {
+      std::swap(lhs, rhs);
+    }
+    rhs -= lhs;
+  }
+  return lhs << shift;
+}
+
+// A product of the steps a -= q b, which is M <- M [[1, q], [0, 1]], and
+// b -= q a, which is M <- M [[1, 0], [q, 1]]. The original pair is M times
+// the reduced one; entries are nonnegative and the determinant is 1.
+struct GcdMatrix {
+  LimbVector entries[2][2] = {{{1}, {}}, {{}, {1}}};
+};
+
+// The same with one-limb entries, below 2^62 so that they also fit int64_t.
+struct LehmerMatrix {
+  Limb entries[2][2] = {{1, 0}, {0, 1}};
+};
+
+// floor(number / 2^shift) mod 2^128.
+DoubleLimb TopBits(const LimbVector& number, size_t shift) {
+  size_t index = shift / 64;
+  unsigned bit = shift % 64;
+  auto limb = [&number](size_t i) -> DoubleLimb {
+    return i < number.size() ? number[i] : 0;
+  };
+
+  DoubleLimb value = (limb(index + 1) << 64) | limb(index);
+  if (bit != 0) {
+    value = (value >> bit) | (limb(index + 2) << (128 - bit));
+  }
+  return value;
+}
+
+// Lehmer's step: runs Euclid's algorithm on the leading 128 bits x, y of a
+// and b, both shifted right by k bits. With the reduced top bits (x', y'),
+// M^-1 (a, b) = (x' 2^k + m11 a_low - m01 b_low, ...) with a_low, b_low
+// below 2^k, so a' >= (x' - m01) 2^k and b' >= (y' - m10) 2^k. Steps are
+// taken while these bounds stay at least B^s. Each full step removes about
+// 64 bits from a and b. Returns false if not even one step is possible.
+bool ComputeLehmerMatrix(const LimbVector& a, const LimbVector& b, size_t s,
+                         LehmerMatrix& matrix) {
+  size_t bits = std::max(BitLengthOf(a), BitLengthOf(b));
+  if (bits <= 128) {
+    return false;
+  }
+  size_t shift = bits - 128;
+
+  DoubleLimb floor = 1;
+  if (64 * s > shift) {
+    if (64 * s - shift >= 127) {
+      return false;
+    }
+    floor <<= 64 * s - shift;
+  }
+
+  const Limb max_entry = Limb{1} << 62;
+  DoubleLimb x = TopBits(a, shift);
+  DoubleLimb y = TopBits(b, shift);
+  auto& m = matrix.entries;
+  m[0][0] = m[1][1] = 1;
+  m[0][1] = m[1][0] = 0;
+  bool progress = false;
+
+  for (;;) {
+    // Reduce the larger of x and y: column `target` gains q times the other.
+    bool reduce_x = x >= y;
+    DoubleLimb& larger = reduce_x ? x : y;
+    DoubleLimb smaller = reduce_x ? y : x;
+    int target = reduce_x ? 1 : 0;
+    if (smaller == 0) {
+      break;
+    }
+
+    // Most quotients are below 4; the rest mostly fit a 64-bit division.
+    Limb quotient = 1;
+    DoubleLimb remainder = larger - smaller;
+    while (remainder >= smaller && quotient < 4) {
+      remainder -= smaller;
+      ++quotient;
+    }
+    if (remainder >= smaller) {
+      DoubleLimb full = (larger >> 64) == 0
+                            ? static_cast<Limb>(larger) /
+                                  static_cast<Limb>(smaller)
+                            : larger / smaller;
+      if (full >= max_entry) {
+        break;
+      }
+      quotient = static_cast<Limb>(full);
+      remainder = larger - full * smaller;
+    }
+
+    // Entries and quotient are below 2^62, so these sums do not overflow.
+    DoubleLimb first =
+        m[0][target] + static_cast<DoubleLimb>(quotient) * m[0][1 - target];
+    DoubleLimb second =
+        m[1][target] + static_cast<DoubleLimb>(quotient) * m[1][1 - target];
+    // The bound of a' involves m01 and that of b' involves m10.
+    DoubleLimb bound = reduce_x ? first : second;
+    if (first >= max_entry || second >= max_entry || remainder < floor ||
+        remainder - floor < bound) {
+      break;
+    }
+
+    larger = remainder;
+    m[0][target] = static_cast<Limb>(first);
+    m[1][target] = static_cast<Limb>(second);
+    progress = true;
+  }
+
+  return progress;
+}
+
+// (a, b) <- M^-1 (a, b) = (m11 a - m01 b, m00 b - m10 a). `alpha` and `beta`
+// are scratch vectors whose storage is swapped into a and b.
+void ApplyLehmerMatrix(LimbVector& a, LimbVector& b,
+                       const LehmerMatrix& matrix, LimbVector& alpha,
+                       LimbVector& beta) {
+  const auto& m = matrix.entries;
+  size_t n = std::max(a.size(), b.size());
+  a.resize(n);
+  b.resize(n);
+  alpha.resize(n + 1);
+  beta.resize(n + 1);
+  std::fill(alpha.begin(), alpha.end(), 0);
+  std::fill(beta.begin(), beta.end(), 0);
+
+  alpha[n] = AddMultipliedLimbs(alpha.data(), a.data(), n, m[1][1]);
+  alpha[n] -= SubtractMultipliedLimbs(alpha.data(), b.data(), n, m[0][1]);
+  beta[n] = AddMultipliedLimbs(beta.data(), b.data(), n, m[0][0]);
+  beta[n] -= SubtractMultipliedLimbs(beta.data(), a.data(), n, m[1][0]);
+
+  TrimLimbs(alpha);
+  TrimLimbs(beta);
+  a.swap(alpha);
+  b.swap(beta);
+}
+
+// x p + y q.
+LimbVector LinearCombination(const LimbVector& x, Limb p, const LimbVector& y,
+                             Limb q) {
+  LimbVector result(std::max(x.size(), y.size()) + 2);
+  for (auto [term, factor] : {std::pair(&x, p), std::pair(&y, q)}) {
+    if (term->empty()) {
+      continue;
+    }
+    Limb carry = AddMultipliedLimbs(result.data(), term->data(), term->size(),
+                                    factor);
+    AddLimbs(result.data() + term->size(), result.data() + term->size(),
+             result.size() - term->size(), &carry, 1);
+  }
+  TrimLimbs(result);
+  return result;
+}
+
+void MultiplyByLehmer(GcdMatrix& matrix, const LehmerMatrix& lehmer) {
+  const auto& l = lehmer.entries;
+  for (auto& row : matrix.entries) {
+    LimbVector first = LinearCombination(row[0], l[0][0], row[1], l[1][0]);
+    row[1] = LinearCombination(row[0], l[0][1], row[1], l[1][1]);
+    row[0] = std::move(first);
+  }
+}
+
+GcdMatrix MultiplyMatrices(const GcdMatrix& lhs, const GcdMatrix& rhs) {
+  GcdMatrix result;
+  for (int i = 0; i < 2; ++i) {
+    for (int j = 0; j < 2; ++j) {
+      result.entries[i][j] =
+          Sum(Product(lhs.entries[i][0], rhs.entries[0][j]),
+              Product(lhs.entries[i][1], rhs.entries[1][j]));
+    }
+  }
+  return result;
+}
+
+// One subtraction-and-division step a -= q b or b -= q a on the larger
+// number that leaves both above B^s (Möller, On Schönhage's algorithm and
+// subquadratic integer gcd computation, 2008, the step of hgcd that
+// handles large quotients). Returns false if none exists.
+bool HgcdDivisionStep(LimbVector& a, LimbVector& b, size_t s,
+                      GcdMatrix& matrix) {
+  bool reduce_a = CompareMagnitude(a, b) >= 0;
+  LimbVector& larger = reduce_a ? a : b;
+  const LimbVector& smaller = reduce_a ? b : a;
+  if (smaller.size() <= s || Difference(larger, smaller).size() <= s) {
+    return false;
+  }
+
+  auto [quotient, remainder] = DivideMagnitude(larger, smaller);
+  if (remainder.size() <= s) {
+    // Then q >= 2, since larger - smaller is above B^s.
+    DecrementLimbs(quotient.data(), quotient.size());
+    TrimLimbs(quotient);
+    remainder = Sum(remainder, smaller);
+  }
+  larger = std::move(remainder);
+
+  int target = reduce_a ? 1 : 0;
+  for (auto& row : matrix.entries) {
+    row[target] = Sum(row[target], Product(quotient, row[1 - target]));
+  }
+  return true;
+}
+
+bool HgcdStep(LimbVector& a, LimbVector& b, size_t s, GcdMatrix& matrix,
+              LimbVector& alpha, LimbVector& beta) {
+  LehmerMatrix lehmer;
+  if (ComputeLehmerMatrix(a, b, s, lehmer)) {
+    ApplyLehmerMatrix(a, b, lehmer, alpha, beta);
+    MultiplyByLehmer(matrix, lehmer);
+    return true;
+  }
+  return HgcdDivisionStep(a, b, s, matrix);
+}
+
+// Given the reduced high parts of a and b above B^p and the matrix that
+// reduced them, sets (a, b) to M^-1 (a, b). Only the low parts need
+// multiplying: a' = a_high' B^p + m11 a_low - m01 b_low.
+void ApplyHighMatrix(LimbVector& a, LimbVector& b, const LimbVector& a_high,
+                     const LimbVector& b_high, size_t p,
+                     const GcdMatrix& matrix) {
+  const auto& m = matrix.entries;
+  LimbVector a_low = LimbsBelow(a, p);
+  LimbVector b_low = LimbsBelow(b, p);
+  auto shifted = [p](const LimbVector& high) {
+    LimbVector result(p + high.size());
+    std::copy(high.begin(), high.end(), result.begin() + p);
+    TrimLimbs(result);
+    return result;
+  };
+
+  a = Difference(Sum(shifted(a_high), Product(m[1][1], a_low)),
+                 Product(m[0][1], b_low));
+  b = Difference(Sum(shifted(b_high), Product(m[0][0], b_low)),
+                 Product(m[1][0], a_low));
+}
+
+// Half gcd (Möller 2008, Algorithm hgcd). For a and b of at most n limbs and
+// s = n / 2 + 1, reduces them to M^-1 (a, b) with both still above B^s,
+// taking about half of their Euclidean remainder sequence. `matrix` starts
+// as the identity and receives M. Recursing on the top halves twice gives
+// O(M(n) log n) time. Returns false if nothing could be reduced.
+//
+// Entries of M are below B^(n - s) < B^s, as a >= m01 b' and b' >= B^s.
+// For a matrix computed from floor(a / B^p) and floor(b / B^p) this bounds
+// the low-part terms of ApplyHighMatrix below the reduced high parts, so
+// the full values stay positive and above B^(s_high + p).
+bool Hgcd(LimbVector& a, LimbVector& b, GcdMatrix& matrix, LimbVector& alpha,
+          LimbVector& beta) {
+  size_t n = std::max(a.size(), b.size());
+  size_t s = n / 2 + 1;
+  if (std::min(a.size(), b.size()) <= s) {
+    return false;
+  }
+
+  bool progress = false;
+  if (n >= std::max<size_t>(BigInteger::Thresholds().gcd_limbs, 8)) {
+    size_t p = n / 2;
+    LimbVector a_high = HighLimbs(a, p);
+    LimbVector b_high = HighLimbs(b, p);
+    if (Hgcd(a_high, b_high, matrix, alpha, beta)) {
+      ApplyHighMatrix(a, b, a_high, b_high, p, matrix);
+      progress = true;
+    }
+
+    // The first call leaves about 3n / 4 limbs; make sure of it before the
+    // second one, which takes the rest down to s.
+    while (std::max(a.size(), b.size()) > 3 * n / 4 + 1) {
+      if (!HgcdStep(a, b, s, matrix, alpha, beta)) {
+        return progress;
+      }
+      progress = true;
+    }
+
+    size_t size = std::max(a.size(), b.size());
+    if (size > s + 2) {
+      p = 2 * s - size + 1;
+      a_high = HighLimbs(a, p);
+      b_high = HighLimbs(b, p);
+      GcdMatrix second;
+      if (Hgcd(a_high, b_high, second, alpha, beta)) {
+        ApplyHighMatrix(a, b, a_high, b_high, p, second);
+        matrix = MultiplyMatrices(matrix, second);
+        progress = true;
+      }
+    }
+  }
+
+  while (HgcdStep(a, b, s, matrix, alpha, beta)) {
+    progress = true;
+  }
+  return progress;
+}
+
+void MultiplyAddSmall(LimbVector& number, Limb multiplier, Limb addend) {
+  Limb carry = MultiplyLimbsBy(number.data(), number.data(), number.size(),
+                               multiplier);
+  for (auto& limb : number) {
+    if (addend == 0) {
+      break;
+    }
+    limb += addend;
+    addend = static_cast<Limb>(limb < addend);
+  }
+
+  carry += addend;
+  if (carry != 0) {
+    number.push_back(carry);
+  }
+}
+
+Limb DivideSmall(LimbVector& number, Limb divisor) {
+  DoubleLimb remainder = 0;
+  for (size_t i = number.size(); i-- > 0;) {
+    DoubleLimb current = (remainder << 64) | number[i];
+    number[i] = static_cast<Limb>(current / divisor);
+    remainder = current % divisor;
+  }
+
+  while (!number.empty() && number.back() == 0) {
+    number.pop_back();
+  }
+
+  return static_cast<Limb>(remainder);
+}
+
+constexpr char kDigitChars[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+void CheckBase(int base) {
+  if (base < 2 || base > 36) {
+    throw std::invalid_argument("BigInteger: base must be between 2 and 36");
+  }
+}
+
+// The largest power of a base that fits in a limb, and its exponent.
+struct Radix {
+  int base;
+  size_t digits;
+  Limb power;
+};
+
+Radix MakeRadix(int base) {
+  Radix radix{base, 1, static_cast<Limb>(base)};
+  while (radix.power <= ~Limb{0} / static_cast<Limb>(base)) {
+    radix.power *= static_cast<Limb>(base);
+    ++radix.digits;
+  }
+  return radix;
+}
+
+// Collects output characters either in a caller's buffer or in a fixed
+// chunk that is handed to a stream whenever it fills up.
+class DigitWriter {
+ public:
+  explicit DigitWriter(char* buffer) : next_(buffer) {}
+  explicit DigitWriter(std::ostream& stream)
+      : stream_(&stream), next_(chunk_) {}
+
+  void Put(char chr) {
+    if (stream_ != nullptr && next_ == chunk_ + kChunkSize) {
+      Flush();
+    }
+    *next_++ = chr;
+  }
+
+  void PutZeros(size_t count) {
+    for (; count > 0; --count) {
+      Put('0');
+    }
+  }
+
+  // Writes `digits` digits of `value`, or all of its significant digits if
+  // `digits` is 0.
+  void PutLimb(Limb value, const Radix& radix, size_t digits) {
+    char reversed[64];
+    size_t length = 0;
+    do {
+      reversed[length++] =
+          kDigitChars[value % static_cast<Limb>(radix.base)];
+      value /= static_cast<Limb>(radix.base);
+    } while (value != 0);
+
+    PutZeros(digits > length ? digits - length : 0);
+    while (length > 0) {
+      Put(reversed[--length]);
+    }
+  }
+
+  // Returns the end of the written characters in buffer mode.
+  char* Flush() {
+    if (stream_ != nullptr) {
+      stream_->write(chunk_, next_ - chunk_);
+      next_ = chunk_;
+    }
+    return next_;
+  }
+
+ private:
+  static constexpr size_t kChunkSize = 4096;
+
+  std::ostream* stream_ = nullptr;
+  char* next_;
+  char chunk_[kChunkSize];
+};
+
+// Appends the square of the last power to a tree of powers
+// radix.power^(2^i).
+void SquareLastPower(std::vector<LimbVector>& powers) {
+  LimbVector square = MultiplyMagnitude(powers.back(), powers.back());
+  while (square.back() == 0) {
+    square.pop_back();
+  }
+  powers.push_back(std::move(square));
+}
+
+// Quadratic conversion by repeated division by radix.power. With a nonzero
+// `width` the output is padded with leading zeros to exactly `width`
+// characters, otherwise it starts at the first significant digit.
+void WriteRadixBasecase(DigitWriter& writer, const Limb* number, size_t size,
+                        const Radix& radix, size_t width) {
+  LimbVector magnitude(number, number + size);
+  std::vector<Limb> chunks;
+  while (!magnitude.empty()) {
+    chunks.push_back(DivideSmall(magnitude, radix.power));
+  }
+
+  size_t i = chunks.size();
+  if (width > 0) {
+    writer.PutZeros(width - chunks.size() * radix.digits);
+  } else if (i > 0) {
+    --i;
+    writer.PutLimb(chunks[i], radix, 0);
+  }
+
+  while (i-- > 0) {
+    writer.PutLimb(chunks[i], radix, radix.digits);
+  }
+}
+
+// Writes a number below powers[level]^2, splitting it into a quotient and a
+// remainder by powers[level], where powers[i] = radix.power^(2^i). Each half
+// needs a division of half the size, so the total cost is
+// O(M(n) log n) with M the multiplication time.
+void WriteRadix(DigitWriter& writer, const Limb* number, size_t size,
+                const std::vector<LimbVector>& powers, size_t level,
+                const Radix& radix, bool pad) {
+  size = SignificantLimbs(number, size);
+  size_t width = pad ? radix.digits << (level + 1) : 0;
+  if (level == 0 || size < BigInteger::Thresholds().conversion_limbs) {
+    WriteRadixBasecase(writer, number, size, radix, width);
+    return;
+  }
+
+  const LimbVector& power = powers[level];
+  if (CompareLimbs(number, size, power.data(), power.size()) < 0) {
+    if (pad) {
+      writer.PutZeros(width / 2);
+    }
+    WriteRadix(writer, number, size, powers, level - 1, radix, pad);
+    return;
+  }
 
-  for (size_t i = 0; i < integer.number_.size(); ++i) {
-    if (std::stoi(integer.number_[i]) != 0) {
-      break;
+  ScratchBuffer quotient(size - power.size() + 1);
+  ScratchBuffer remainder(power.size());
+  DivideLimbs(quotient.data(), remainder.data(), number, size, power.data(),
+              power.size());
+  WriteRadix(writer, quotient.data(), quotient.size(), powers, level - 1,
+             radix, pad);
+  WriteRadix(writer, remainder.data(), remainder.size(), powers, level - 1,
+             radix, true);
+}
+
+// Power-of-two bases are a plain regrouping of bits.
+void WriteBits(DigitWriter& writer, const Limb* number, size_t size,
+               unsigned digit_bits) {
+  size_t bit_length =
+      size * 64 - static_cast<size_t>(__builtin_clzll(number[size - 1]));
+  const Limb mask = (Limb{1} << digit_bits) - 1;
+
+  for (size_t i = (bit_length + digit_bits - 1) / digit_bits; i-- > 0;) {
+    size_t bit = i * digit_bits;
+    size_t limb = bit / 64;
+    unsigned offset = static_cast<unsigned>(bit % 64);
+
+    Limb value = number[limb] >> offset;
+    if (offset + digit_bits > 64 && limb + 1 < size) {
+      value |= number[limb + 1] << (64 - offset);
+    }
+    writer.Put(kDigitChars[value & mask]);
+  }
+}
+
+void WriteInteger(DigitWriter& writer, const LimbVector& number,
+                  int sign, int base) {
+  if (number.empty()) {
+    writer.Put('0');
+    return;
+  }
+
+  if (sign < 0) {
+    writer.Put('-');
+  }
+
+  if ((base & (base - 1)) == 0) {
+    unsigned digit_bits =
+        static_cast<unsigned>(__builtin_ctz(static_cast<unsigned>(base)));
+    WriteBits(writer, number.data(), number.size(), digit_bits);
+    return;
+  }
+
+  Radix radix = MakeRadix(base);
+  if (number.size() < BigInteger::Thresholds().conversion_limbs) {
+    WriteRadixBasecase(writer, number.data(), number.size(), radix, 0);
+    return;
+  }
+
+  std::vector<LimbVector> powers = {{radix.power}};
+  while (2 * powers.back().size() - 1 <= number.size()) {
+    SquareLastPower(powers);
+  }
+
+  // The last power has s limbs with 2s - 1 > n, so its square exceeds the
+  // number.
+  WriteRadix(writer, number.data(), number.size(), powers, powers.size() - 1,
+             radix, false);
+}
+
+// Limbs taken by a number of `length` digits, rounded up.
+size_t LimbsForDigits(size_t length, const Radix& radix) {
+  double bits = static_cast<double>(length) * std::log2(radix.base);
+  return static_cast<size_t>(std::ceil(bits / 64));
+}
+
+// Quadratic parsing, one limb-sized chunk of digits at a time. Digits are
+// '0' to '9', so radix.base must not exceed 10.
+LimbVector ReadRadixBasecase(const char* digits, size_t length,
+                             const Radix& radix) {
+  LimbVector number;
+  number.reserve(length / radix.digits + 1);
+
+  size_t chunk_length = length % radix.digits;
+  if (chunk_length == 0) {
+    chunk_length = radix.digits;
+  }
+
+  for (size_t position = 0; position < length;
+       position += chunk_length, chunk_length = radix.digits) {
+    Limb chunk = 0;
+    Limb multiplier = 1;
+    for (size_t i = 0; i < chunk_length; ++i) {
+      chunk = chunk * static_cast<Limb>(radix.base) +
+              static_cast<Limb>(digits[position + i] - '0');
+      multiplier *= static_cast<Limb>(radix.base);
+    }
+
+    MultiplyAddSmall(number, multiplier, chunk);
+  }
+
+  return number;
+}
+
+// Parses the digits as high * powers[level] + low, where low is made of the
+// last radix.digits * 2^level digits and level is the largest one that
+// leaves a nonempty high part. The multiplications form a product tree, so
+// the total cost is O(M(n) log n).
+LimbVector ReadRadix(const char* digits, size_t length,
+                     const std::vector<LimbVector>& powers,
+                     const Radix& radix) {
+  size_t threshold =
+      std::max<size_t>(BigInteger::Thresholds().parse_limbs, 2);
+  if (LimbsForDigits(length, radix) < threshold) {
+    return ReadRadixBasecase(digits, length, radix);
+  }
+
+  size_t level = powers.size() - 1;
+  while ((radix.digits << level) >= length) {
+    --level;
+  }
+
+  size_t low_length = radix.digits << level;
+  LimbVector high = ReadRadix(digits, length - low_length, powers, radix);
+  LimbVector low =
+      ReadRadix(digits + length - low_length, low_length, powers, radix);
+  if (high.empty()) {
+    return low;
+  }
+
+  // high * power + low < (high + 1) * power, so the sum cannot carry out.
+  const LimbVector& power = powers[level];
+  LimbVector number(high.size() + power.size());
+  MultiplyLimbs(number.data(), high.data(), high.size(), power.data(),
+                power.size());
+  AddLimbs(number.data(), number.data(), number.size(), low.data(),
+           low.size());
+
+  while (number.back() == 0) {
+    number.pop_back();
+  }
+  return number;
+}
+
+// Destination of lazy expressions whose terms refer to the number being
+// assigned. Like the other thread-local buffers it outlives any memory
+// scope, so it allocates with operator new.
+BigInteger& EvaluationBuffer() {
+  static thread_local BigInteger buffer = [] {
+    BigIntegerMemoryScope heap(nullptr);
+    return BigInteger();
+  }();
+  return buffer;
+}
+
+// Numbers of at most one limb take the native 128-bit fast paths below:
+// their sums and differences fit in SignedDoubleLimb and their products in
+// DoubleLimb.
+bool IsSingleLimb(const LimbVector& number) { return number.size() <= 1; }
+
+Limb LowLimb(const LimbVector& number) {
+  return number.empty() ? 0 : number[0];
+}
+
+// The value of a number below 2^128.
+DoubleLimb LowLimbs(const LimbVector& number) {
+  DoubleLimb value = LowLimb(number);
+  if (number.size() > 1) {
+    value |= static_cast<DoubleLimb>(number[1]) << 64;
+  }
+  return value;
+}
+
+SignedDoubleLimb SingleLimbValue(const LimbVector& number, int sign) {
+  return sign * static_cast<SignedDoubleLimb>(LowLimb(number));
+}
+
+// Stores a magnitude below 2^128, which always fits in the inline limbs.
+void AssignMagnitude(LimbVector& number, DoubleLimb magnitude) {
+  number.clear();
+  if (magnitude != 0) {
+    number.push_back(static_cast<Limb>(magnitude));
+  }
+  if ((magnitude >> 64) != 0) {
+    number.push_back(static_cast<Limb>(magnitude >> 64));
+  }
+}
+
+void AssignSigned(LimbVector& number, int& sign, SignedDoubleLimb value) {
+  sign = value < 0 ? -1 : 1;
+  AssignMagnitude(number, value < 0 ? 0 - static_cast<DoubleLimb>(value)
+                                    : static_cast<DoubleLimb>(value));
+}
+
+// Scratch space of BigInteger::ModContext, shared by all contexts of a
+// thread.
+LimbVector& ModScratch() {
+  static thread_local LimbVector buffer(std::pmr::new_delete_resource());
+  return buffer;
+}
+
+// Destination of operator*=. Its storage is swapped with the number being
+// multiplied, so a loop of products of similar size keeps reusing the same
+// two allocations.
+LimbVector& ProductBuffer() {
+  static thread_local LimbVector buffer(std::pmr::new_delete_resource());
+  return buffer;
+}
+
+// Primes up to n, by a sieve of Eratosthenes over the odd numbers.
+std::vector<Limb> PrimesUpTo(uint64_t n) {
+  std::vector<Limb> primes;
+  if (n < 2) {
+    return primes;
+  }
+
+  primes.push_back(2);
+  std::vector<bool> composite((n - 1) / 2);  // composite[i]: 2i + 3
+  for (size_t i = 0; i < composite.size(); ++i) {
+    if (composite[i]) {
+      continue;
+    }
+    Limb p = 2 * i + 3;
+    primes.push_back(p);
+    if (p <= n / p) {
+      for (size_t j = (p * p - 3) / 2; j < composite.size(); j += p) {
+        composite[j] = true;
+      }
+    }
+  }
+  return primes;
+}
+
+// Products of consecutive factors, each as large as fits in a limb.
+std::vector<Limb> PackFactors(const std::vector<Limb>& factors) {
+  std::vector<Limb> packed;
+  Limb current = 1;
+  for (Limb factor : factors) {
+    DoubleLimb product = static_cast<DoubleLimb>(current) * factor;
+    if ((product >> 64) != 0) {
+      packed.push_back(current);
+      current = factor;
+    } else {
+      current = static_cast<Limb>(product);
+    }
+  }
+  if (current != 1 || packed.empty()) {
+    packed.push_back(current);
+  }
+  return packed;
+}
+
+// Product of count nonzero limbs as a balanced tree, so that the large
+// products are of equal halves and use the subquadratic tiers. Above
+// Thresholds().parallel_limbs the two halves of a node are forked to the
+// pool, and then go through operator new, as pool threads must not use the
+// memory resource of the caller.
+LimbVector ProductTree(const Limb* factors, size_t count) {
+  if (count <= 16) {
+    LimbVector result = {factors[0]};
+    for (size_t i = 1; i < count; ++i) {
+      MultiplyAddSmall(result, factors[i], 0);
+    }
+    return result;
+  }
+
+  size_t half = count / 2;
+  std::pmr::memory_resource* resource =
+      Parallel(half) ? std::pmr::new_delete_resource()
+                     : BigInteger::MemoryResource();
+  LimbVector low(resource);
+  LimbVector high(resource);
+  Fork(
+      half, [&] { low = ProductTree(factors, half); },
+      [&] { high = ProductTree(factors + half, count - half); });
+  return Product(low, high);
+}
+
+}  // namespace
+
+BigIntegerThresholds& BigInteger::Thresholds() {
+  static BigIntegerThresholds thresholds;
+  return thresholds;
+}
+
+void BigInteger::Normalize() {
+  while (!number_.empty() && number_.back() == 0) {
+    number_.pop_back();
+  }
+
+  if (number_.empty()) {
+    sign_ = 1;
+  }
+}
+
+size_t BigInteger::MaxLimbs() { return max_limbs_; }
+
+void BigInteger::SetMaxLimbs(size_t limbs) { max_limbs_ = limbs; }
+
+size_t BigInteger::Threads() { return ThreadCount(); }
+
+void BigInteger::SetThreads(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  std::lock_guard<std::mutex> lock(PoolMutex());
+  ThreadCount() = threads;
+  PoolSlot() = threads > 1 ? std::make_shared<ThreadPool>(threads) : nullptr;
+}
+
+BigIntegerLimitScope::BigIntegerLimitScope(size_t limbs)
+    : previous_(BigInteger::MaxLimbs()) {
+  BigInteger::SetMaxLimbs(limbs);
+}
+
+BigIntegerLimitScope::~BigIntegerLimitScope() {
+  BigInteger::SetMaxLimbs(previous_);
+}
+
+std::pmr::memory_resource* BigInteger::MemoryResource() {
+  return LimbVector::ThreadResource();
+}
+
+void BigInteger::SetMemoryResource(std::pmr::memory_resource* resource) {
+  LimbVector::SetThreadResource(resource);
+}
+
+BigIntegerMemoryScope::BigIntegerMemoryScope(
+    std::pmr::memory_resource* resource)
+    : previous_(BigInteger::MemoryResource()) {
+  BigInteger::SetMemoryResource(resource);
+}
+
+BigIntegerMemoryScope::~BigIntegerMemoryScope() {
+  BigInteger::SetMemoryResource(previous_);
+}
+
+void BigInteger::ReserveScratch(size_t limbs) {
+  ScratchWorkspace::ForThread().Reserve(limbs);
+}
+
+size_t BigInteger::ScratchCapacity() {
+  return ScratchWorkspace::ForThread().Capacity();
+}
+
+size_t BigInteger::ScratchHighWater() {
+  return ScratchWorkspace::ForThread().HighWater();
+}
+
+void BigInteger::AssignDecimal(const char* str, size_t length) {
+  int sign = 1;
+  if (length > 0 && (str[0] == '-' || str[0] == '+')) {
+    sign = (str[0] == '-') ? -1 : 1;
+    ++str;
+    --length;
+  }
+
+  // A limb holds less than 20 decimal digits, so longer strings cannot fit
+  // and are rejected before parsing. The default limit also keeps the exact
+  // decimal bound of the former representation.
+  size_t first_digit = 0;
+  while (first_digit < length && str[first_digit] == '0') {
+    ++first_digit;
+  }
+  size_t digits = length - first_digit;
+  if (digits / 20 > max_limbs_ ||
+      (max_limbs_ == kMaxLimbs && digits > kMaxDecimalDigits)) {
+    throw BigIntegerOverflow();
+  }
+
+  for (size_t i = 0; i < length; ++i) {
+    if (str[i] < '0' || str[i] > '9') {
+      throw std::invalid_argument("BigInteger: invalid decimal string");
+    }
+  }
+
+  Radix radix = MakeRadix(10);
+  std::vector<LimbVector> powers;
+  if (LimbsForDigits(length, radix) >= Thresholds().parse_limbs) {
+    powers.push_back({radix.power});
+    while ((radix.digits << powers.size()) < length) {
+      SquareLastPower(powers);
+    }
+  }
+
+  number_ = ReadRadix(str, length, powers, radix);
+
+  sign_ = sign;
+  Normalize();
+  CheckLimbCount(number_.size());
+}
+
+BigInteger::BigInteger(const char* str) {
+  AssignDecimal(str, std::strlen(str));
+}
+
+BigInteger::BigInteger(int64_t num) {
+  Limb magnitude = static_cast<Limb>(num);
+  if (num < 0) {
+    sign_ = -1;
+    magnitude = ~magnitude + 1;
+  }
+
+  if (magnitude != 0) {
+    number_.push_back(magnitude);
+  }
+}
+
+bool BigInteger::IsNegative() const { return sign_ != 1; }
+
+BigInteger BigInteger::operator+() const { return *this; }
+
+BigInteger BigInteger::operator-() const& {
+  return -BigInteger(*this);
+}
+
+BigInteger BigInteger::operator-() && {
+  if (!number_.empty()) {
+    sign_ *= -1;
+  }
+
+  return std::move(*this);
+}
+
+bool operator<(const BigInteger& integer1, const BigInteger& integer2) {
+  if (integer1.sign_ != integer2.sign_) {
+    return integer1.sign_ < integer2.sign_;
+  }
+
+  int comparison = CompareMagnitude(integer1.number_, integer2.number_);
+  return integer1.sign_ == 1 ? comparison < 0 : comparison > 0;
+}
+
+bool operator>(const BigInteger& integer1, const BigInteger& integer2) {
+  return integer2 < integer1;
+}
+
+bool operator<=(const BigInteger& integer1, const BigInteger& integer2) {
+  return !(integer1 > integer2);
+}
+
+bool operator>=(const BigInteger& integer1, const BigInteger& integer2) {
+  return !(integer1 < integer2);
+}
+
+BigInteger BigInteger::AddSigned(const BigInteger& lhs, const BigInteger& rhs,
+                                 int rhs_sign) {
+  BigInteger result;
+
+  if (IsSingleLimb(lhs.number_) && IsSingleLimb(rhs.number_)) {
+    AssignSigned(result.number_, result.sign_,
+                 SingleLimbValue(lhs.number_, lhs.sign_) +
+                     SingleLimbValue(rhs.number_, rhs_sign));
+    CheckLimbCount(result.number_.size());
+    return result;
+  }
+
+  if (rhs.number_.empty() || lhs.sign_ == rhs_sign) {
+    result.sign_ = lhs.sign_;
+    result.number_ = AddMagnitude(lhs.number_, rhs.number_);
+    result.Normalize();
+    CheckLimbCount(result.number_.size());
+    return result;
+  }
+
+  if (CompareMagnitude(lhs.number_, rhs.number_) >= 0) {
+    result.sign_ = lhs.sign_;
+    result.number_ = SubtractMagnitude(lhs.number_, rhs.number_);
+  } else {
+    result.sign_ = rhs_sign;
+    result.number_ = SubtractMagnitude(rhs.number_, lhs.number_);
+  }
+
+  result.Normalize();
+  return result;
+}
+
+BigInteger BigInteger::operator+(const BigInteger& integer) const& {
+  return AddSigned(*this, integer, integer.sign_);
+}
+
+BigInteger BigInteger::operator+(const BigInteger& integer) && {
+  *this += integer;
+  return std::move(*this);
+}
+
+BigInteger BigInteger::operator+(BigInteger&& integer) const& {
+  integer += *this;
+  return std::move(integer);
+}
+
+BigInteger BigInteger::operator+(BigInteger&& integer) && {
+  *this += integer;
+  return std::move(*this);
+}
+
+void BigInteger::AddInPlace(const BigInteger& integer, int integer_sign) {
+  const LimbVector& rhs = integer.number_;
+  size_t size = number_.size();
+
+  if (rhs.empty()) {
+    return;
+  }
+
+  if (IsSingleLimb(number_) && IsSingleLimb(rhs)) {
+    SignedDoubleLimb sum = SingleLimbValue(number_, sign_) +
+                           SingleLimbValue(rhs, integer_sign);
+    LimbVector result;
+    int result_sign = 1;
+    AssignSigned(result, result_sign, sum);
+    CheckLimbCount(result.size());
+    number_ = result;
+    sign_ = result_sign;
+    return;
+  }
+
+  if (number_.empty() || sign_ == integer_sign) {
+    // A sum at the size limit may overflow it; the copying version checks
+    // that without touching *this.
+    if (std::max(size, rhs.size()) >= max_limbs_) {
+      *this = AddSigned(*this, integer, integer_sign);
+      return;
+    }
+
+    sign_ = integer_sign;
+    if (rhs.size() > size) {
+      number_.resize(rhs.size());
+    }
+
+    // Adding a number to itself is safe: each limb is read before it is
+    // written.
+    Limb carry = AddLimbs(number_.data(), number_.data(), number_.size(),
+                          rhs.data(), rhs.size());
+    if (carry != 0) {
+      number_.push_back(carry);
+    }
+    return;
+  }
+
+  if (CompareMagnitude(number_, rhs) >= 0) {
+    SubtractLimbs(number_.data(), number_.data(), size, rhs.data(),
+                  rhs.size());
+  } else {
+    number_.resize(rhs.size());
+    SubtractLimbs(number_.data(), rhs.data(), rhs.size(), number_.data(),
+                  size);
+    sign_ = integer_sign;
+  }
+
+  Normalize();
+}
+
+void BigInteger::AddUnit(int sign) {
+  if (number_.empty()) {
+    number_.push_back(1);
+    sign_ = sign;
+    return;
+  }
+
+  if (sign_ != sign) {
+    DecrementLimbs(number_.data(), number_.size());
+    Normalize();
+    return;
+  }
+
+  for (auto& limb : number_) {
+    if (++limb != 0) {
+      return;
+    }
+  }
+
+  // Every limb wrapped around to zero.
+  if (number_.size() + 1 > max_limbs_) {
+    std::fill(number_.begin(), number_.end(), ~Limb{0});
+    throw BigIntegerOverflow();
+  }
+  number_.push_back(1);
+}
+
+void BigInteger::AddMultipleInPlace(const Limb* magnitude, size_t size,
+                                    Limb multiplier, int sign) {
+  size = SignificantLimbs(magnitude, size);
+  if (size == 0 || multiplier == 0) {
+    return;
+  }
+
+  if (number_.empty()) {
+    sign_ = sign;
+  }
+
+  size_t length = std::max(number_.size(), size + 1);
+  number_.resize(length);
+  Limb* tail = number_.data() + size;
+
+  if (sign_ == sign) {
+    Limb carry =
+        AddMultipliedLimbs(number_.data(), magnitude, size, multiplier);
+    if (AddLimbs(tail, tail, length - size, &carry, 1) != 0) {
+      number_.push_back(1);
     }
+  } else {
+    // A final borrow means the product was larger: the limbs then hold
+    // B^length minus the magnitude of the result.
+    Limb borrow =
+        SubtractMultipliedLimbs(number_.data(), magnitude, size, multiplier);
+    if (SubtractLimbs(tail, tail, length - size, &borrow, 1) != 0) {
+      NegateTwos(number_.data(), length);
+      sign_ = sign;
+    }
+  }
+
+  Normalize();
+}
+
+void BigInteger::AddTerm(const BigIntegerTerm& term, int sign) {
+  if (term.rhs == nullptr) {
+    const LimbVector& value = term.lhs->number_;
+    AddMultipleInPlace(value.data(), value.size(), 1, sign * term.lhs->sign_);
+    return;
+  }
+
+  const LimbVector* lhs = &term.lhs->number_;
+  const LimbVector* rhs = &term.rhs->number_;
+  if (lhs->empty() || rhs->empty()) {
+    return;
+  }
+
+  sign *= term.lhs->sign_ * term.rhs->sign_;
+  if (lhs->size() < rhs->size()) {
+    std::swap(lhs, rhs);
+  }
+
+  if (rhs->size() == 1) {
+    AddMultipleInPlace(lhs->data(), lhs->size(), (*rhs)[0], sign);
+    return;
+  }
+
+  LimbVector& product = ProductBuffer();
+  product.resize(lhs->size() + rhs->size());
+  MultiplyLimbs(product.data(), lhs->data(), lhs->size(), rhs->data(),
+                rhs->size());
+  AddMultipleInPlace(product.data(), product.size(), 1, sign);
+}
+
+void BigInteger::Evaluate(const BigIntegerTerm* terms, size_t count,
+                          int accumulate) {
+  // Products that cannot fit are rejected before anything is computed. The
+  // sum has at most one limb more than its longest term.
+  bool aliased = false;
+  size_t longest = accumulate != 0 ? number_.size() : 0;
+  for (size_t i = 0; i < count; ++i) {
+    const BigIntegerTerm& term = terms[i];
+    aliased = aliased || term.lhs == this || term.rhs == this;
+
+    size_t size = term.lhs->number_.size();
+    if (term.rhs != nullptr) {
+      if (size == 0 || term.rhs->number_.empty()) {
+        continue;
+      }
+      size += term.rhs->number_.size();
+      CheckProductSize(size);
+    }
+    longest = std::max(longest, size);
+  }
+
+  // Terms that read *this, and sums that may exceed the size limit, are
+  // added into a per-thread buffer whose storage is swapped in at the end,
+  // so that *this is unchanged if the limit throws. Otherwise they go
+  // straight into *this.
+  bool buffered = aliased || longest + 1 > max_limbs_;
+  BigInteger& result = buffered ? EvaluationBuffer() : *this;
+  if (buffered && accumulate != 0) {
+    result.number_ = number_;
+    result.sign_ = sign_;
+  } else if (accumulate == 0) {
+    result.number_.clear();
+    result.sign_ = 1;
+  }
+
+  int sign = accumulate == -1 ? -1 : 1;
+  for (size_t i = 0; i < count; ++i) {
+    result.AddTerm(terms[i], sign * terms[i].sign);
+  }
+
+  CheckLimbCount(result.number_.size());
+  if (buffered) {
+    number_.swap(result.number_);
+    sign_ = result.sign_;
+  }
+}
+
+BigInteger& BigInteger::operator+=(const BigInteger& integer) {
+  AddInPlace(integer, integer.sign_);
+  return *this;
+}
+
+BigInteger BigInteger::operator-(const BigInteger& integer) const& {
+  return AddSigned(*this, integer, -integer.sign_);
+}
 
-    all_zeros = true;
-  }
+BigInteger BigInteger::operator-(const BigInteger& integer) && {
+  *this -= integer;
+  return std::move(*this);
+}
 
-  if (all_zeros) {
-    temp.sign_ = 1;
-  }
+BigInteger BigInteger::operator-(BigInteger&& integer) const& {
+  integer -= *this;
+  return -std::move(integer);
+}
 
-  return temp;
+BigInteger BigInteger::operator-(BigInteger&& integer) && {
+  *this -= integer;
+  return std::move(*this);
 }
 
-BigInteger::BigInteger(const char* str) {
-  std::string char_to_string_with_sign = std::string(str + 1);
-  std::string char_to_string = std::string(str);
+BigInteger& BigInteger::operator-=(const BigInteger& integer) {
+  AddInPlace(integer, -integer.sign_);
+  return *this;
+}
 
-  if (str[0] == '-') {
-    sign_ *= -1;
-    number_ = ParseStringToVector(char_to_string_with_sign, 5);
-  } else if (str[0] == '+') {
-    number_ = ParseStringToVector(char_to_string_with_sign, 5);
+BigInteger BigInteger::operator*(const BigInteger& integer) const& {
+  size_t size = number_.size() + integer.number_.size();
+  CheckProductSize(size);
+
+  BigInteger result;
+  if (IsSingleLimb(number_) && IsSingleLimb(integer.number_)) {
+    AssignMagnitude(result.number_, static_cast<DoubleLimb>(LowLimb(number_)) *
+                                        LowLimb(integer.number_));
   } else {
-    number_ = ParseStringToVector(char_to_string, 5);
+    result.number_ = MultiplyMagnitude(number_, integer.number_);
   }
+  result.sign_ = sign_ * integer.sign_;
+  result.Normalize();
 
-  if (number_.size() > 10000) {
-    throw BigIntegerOverflow();
+  if (size > max_limbs_) {
+    CheckLimbCount(result.number_.size());
   }
+  return result;
 }
 
-BigInteger::BigInteger(int64_t num) {
-  if (num < 0) {
-    sign_ = -1;
-    num = -num;
-  } else {
+BigInteger BigInteger::operator*(const BigInteger& integer) && {
+  *this *= integer;
+  return std::move(*this);
+}
+
+BigInteger BigInteger::operator*(BigInteger&& integer) const& {
+  integer *= *this;
+  return std::move(integer);
+}
+
+BigInteger BigInteger::operator*(BigInteger&& integer) && {
+  *this *= integer;
+  return std::move(*this);
+}
+
+BigInteger& BigInteger::operator*=(const BigInteger& integer) {
+  size_t size = number_.size() + integer.number_.size();
+  CheckProductSize(size);
+
+  if (number_.empty() || integer.number_.empty()) {
+    number_.clear();
     sign_ = 1;
+    return *this;
   }
 
-  number_ = ParseNumberToVector(num, 5);
-}
+  if (IsSingleLimb(number_) && IsSingleLimb(integer.number_)) {
+    DoubleLimb product = static_cast<DoubleLimb>(number_[0]) *
+                         integer.number_[0];
+    CheckLimbCount((product >> 64) != 0 ? 2 : 1);
+    AssignMagnitude(number_, product);
+    sign_ *= integer.sign_;
+    return *this;
+  }
 
-bool BigInteger::IsNegative() const { return sign_ != 1; }
+  LimbVector& product = ProductBuffer();
+  product.resize(number_.size() + integer.number_.size());
+  MultiplyLimbs(product.data(), number_.data(), number_.size(),
+                integer.number_.data(), integer.number_.size());
+  if (product.back() == 0) {
+    product.pop_back();
+  }
+
+  if (size > max_limbs_) {
+    CheckLimbCount(product.size());
+  }
+  number_.swap(product);
+  sign_ *= integer.sign_;
+  return *this;
+}
 
-std::vector<std::string> BigInteger::ParseStringToVector(std::string& str,
-                                                         size_t block_size) {
-  std::vector<std::string> result;
-  std::reverse(str.begin(), str.end());
+BigInteger BigInteger::Square(const BigInteger& integer) {
+  size_t size = 2 * integer.number_.size();
+  CheckProductSize(size);
 
-  for (size_t i = 0; i < str.size(); i += block_size) {
-    std::string sub_string = str.substr(i, block_size);
-    std::reverse(sub_string.begin(), sub_string.end());
-    result.push_back(sub_string);
+  BigInteger result;
+  if (IsSingleLimb(integer.number_)) {
+    DoubleLimb low = LowLimb(integer.number_);
+    AssignMagnitude(result.number_, low * low);
+    return result;
   }
 
-  std::reverse(result.begin(), result.end());
+  result.number_.resize(size);
+  SquareLimbs(result.number_.data(), integer.number_.data(),
+              integer.number_.size());
+  result.Normalize();
+  if (size > max_limbs_) {
+    CheckLimbCount(result.number_.size());
+  }
   return result;
 }
 
-std::vector<std::string> BigInteger::ParseNumberToVector(int64_t number,
-                                                         size_t block_size) {
-  std::string str = std::to_string(number);
+BigInteger BigInteger::Pow(const BigInteger& base, uint64_t exponent) {
+  if (exponent == 0) {
+    return 1;
+  }
+  if (base.number_.empty()) {
+    return BigInteger();
+  }
 
-  std::vector<std::string> result;
-  std::reverse(str.begin(), str.end());
+  size_t bits = base.number_.size() * 64 -
+                static_cast<size_t>(__builtin_clzll(base.number_.back()));
+  if (bits == 1) {
+    return (base.IsNegative() && (exponent & 1) != 0) ? -1 : 1;
+  }
 
-  for (size_t i = 0; i < str.size(); i += block_size) {
-    std::string sub_string = str.substr(i, block_size);
-    std::reverse(sub_string.begin(), sub_string.end());
-    result.push_back(sub_string);
+  // base^exponent has more than (bits - 1) exponent bits.
+  DoubleLimb min_bits = static_cast<DoubleLimb>(bits - 1) * exponent;
+  if (min_bits / 64 >= max_limbs_) {
+    throw BigIntegerOverflow();
   }
 
-  std::reverse(result.begin(), result.end());
+  BigInteger result = base;
+  for (int bit = 62 - __builtin_clzll(exponent); bit >= 0; --bit) {
+    result *= result;
+    if (((exponent >> bit) & 1) != 0) {
+      result *= base;
+    }
+  }
   return result;
 }
 
-std::vector<std::string> BigInteger::AddZeros(std::vector<int>& result) const {
-  std::vector<std::string> formatted_result;
-  std::reverse(result.begin(), result.end());
+std::pair<BigInteger, BigInteger> BigInteger::DivMod(
+    const BigInteger& dividend, const BigInteger& divisor) {
+  if (divisor.number_.empty()) {
+    throw BigIntegerDivisionByZero();
+  }
 
-  for (size_t i = 0; i < result.size(); ++i) {
-    std::string num_str = std::to_string(result[i]);
+  if (CompareMagnitude(dividend.number_, divisor.number_) < 0) {
+    return {BigInteger(), dividend};
+  }
 
-    if (i != 0 && result[i] == 0) {
-      num_str = "00000";
-    } else if (i != 0) {
-      while (num_str.length() < 5) {
-        num_str = "0" + num_str;
-      }
-    }
+  size_t dividend_size = dividend.number_.size();
+  size_t divisor_size = divisor.number_.size();
 
-    formatted_result.push_back(num_str);
+  BigInteger quotient;
+  BigInteger remainder;
+  if (dividend_size <= 2) {
+    DoubleLimb numerator = LowLimbs(dividend.number_);
+    DoubleLimb denominator = LowLimbs(divisor.number_);
+    AssignMagnitude(quotient.number_, numerator / denominator);
+    AssignMagnitude(remainder.number_, numerator % denominator);
+  } else {
+    quotient.number_.resize(dividend_size - divisor_size + 1);
+    remainder.number_.resize(divisor_size);
+    DivideLimbs(quotient.number_.data(), remainder.number_.data(),
+                dividend.number_.data(), dividend_size,
+                divisor.number_.data(), divisor_size);
   }
 
-  return formatted_result;
-}
+  quotient.sign_ = dividend.sign_ * divisor.sign_;
+  remainder.sign_ = dividend.sign_;
+  quotient.Normalize();
+  remainder.Normalize();
 
-BigInteger BigInteger::operator+() const { return *this; }
+  return {std::move(quotient), std::move(remainder)};
+}
 
-BigInteger BigInteger::operator-() const {
-  BigInteger result = *this;
-  if (!result.number_.empty() && result.number_[0] != "0") {
-    result.sign_ *= -1;
-  }
+BigInteger BigInteger::operator/(const BigInteger& integer) const {
+  return DivMod(*this, integer).first;
+}
 
-  return result;
+BigInteger& BigInteger::operator/=(const BigInteger& integer) {
+  *this = *this / integer;
+  return *this;
 }
 
-bool BigInteger::ComparisonForNegativeNumbers(
-    const BigInteger& integer1, const BigInteger& integer2) const {
-  if (integer1.sign_ == -1 && integer2.sign_ == -1) {
-    BigInteger temp1 = integer1;
-    temp1.sign_ = 1;
+BigInteger BigInteger::operator%(const BigInteger& integer) const {
+  return DivMod(*this, integer).second;
+}
 
-    BigInteger temp2 = integer2;
-    temp2.sign_ = 1;
+BigInteger& BigInteger::operator%=(const BigInteger& integer) {
+  *this = *this % integer;
+  return *this;
+}
 
-    return (temp1 < temp2);
+BigInteger BigInteger::PowMod(const BigInteger& base,
+                              const BigInteger& exponent,
+                              const BigInteger& modulus) {
+  if (exponent.IsNegative()) {
+    throw std::invalid_argument("BigInteger: negative exponent");
   }
 
-  if (integer1.number_.size() != integer2.number_.size()) {
-    return integer1.number_.size() < integer2.number_.size();
+  // Values stay in Montgomery form for the whole exponentiation, so odd
+  // moduli pay the conversions only once.
+  bool odd = !modulus.number_.empty() && (modulus.number_[0] & 1) != 0;
+  ModContext context(modulus, odd ? ModContext::Method::kMontgomery
+                                  : ModContext::Method::kBarrett);
+  if (context.modulus_ == 1) {
+    return BigInteger();
   }
 
-  for (size_t i = 0; i < integer1.number_.size(); ++i) {
-    if (integer1.number_[i] != integer2.number_[i]) {
-      return std::stoi(integer1.number_[i]) < std::stoi(integer2.number_[i]);
-    }
+  size_t n = context.modulus_.number_.size();
+  LimbVector scratch(context.ScratchLimbs());
+
+  LimbVector base_form(n);
+  BigInteger reduced = context.Reduce(base);
+  std::copy(reduced.number_.begin(), reduced.number_.end(), base_form.begin());
+  LimbVector one(n);
+  one[0] = 1;
+  if (odd) {
+    context.MultiplyForm(base_form.data(), base_form.data(),
+                         context.r_squared_.data(), scratch.data());
+    context.MultiplyForm(one.data(), one.data(), context.r_squared_.data(),
+                         scratch.data());
   }
 
-  return false;
+  LimbVector power = PowSlidingWindow(
+      base_form, exponent.number_, one,
+      [&context, &scratch](LimbVector& target, const LimbVector& factor) {
+        context.MultiplyForm(target.data(), target.data(), factor.data(),
+                             scratch.data());
+      });
+
+  BigInteger result;
+  result.number_.resize(n);
+  if (odd) {
+    std::copy(power.begin(), power.end(), scratch.begin());
+    std::fill(scratch.begin() + n, scratch.begin() + 2 * n, 0);
+    MontgomeryReduce(result.number_.data(), scratch.data(),
+                     context.modulus_.number_.data(), n, context.inverse_);
+  } else {
+    std::copy(power.begin(), power.end(), result.number_.begin());
+  }
+  result.Normalize();
+  return result;
 }
 
-bool operator<(const BigInteger& integer1, const BigInteger& integer2) {
-  if (integer1.sign_ != integer2.sign_) {
-    return integer1.sign_ < integer2.sign_;
+LimbVector BigInteger::GcdMagnitude(LimbVector a, LimbVector b,
+                                    BigInteger* cofactor) {
+  // a = x_a a0 + y_a b0 and b = x_b a0 + y_b b0 for the inputs a0, b0; only
+  // the x are kept. As in Euclid's algorithm they have opposite signs, and
+  // every step adds a multiple of one magnitude to the other: x_a =
+  // sign u_a and x_b = -sign u_b.
+  bool extended = cofactor != nullptr;
+  LimbVector u_a = {1};
+  LimbVector u_b;
+  int sign = 1;
+  LimbVector alpha;
+  LimbVector beta;
+
+  auto swap = [&] {
+    a.swap(b);
+    u_a.swap(u_b);
+    sign = -sign;
+  };
+
+  if (CompareMagnitude(a, b) < 0) {
+    swap();
   }
 
-  if (integer1.number_.size() != integer2.number_.size()) {
-    return integer1.sign_ == 1
-               ? integer1.number_.size() < integer2.number_.size()
-               : integer1.number_.size() > integer2.number_.size();
-  }
+  while (!b.empty()) {
+    if (a.size() <= 2) {
+      DoubleLimb x = LowLimbs(a);
+      DoubleLimb y = LowLimbs(b);
+      if (!extended) {
+        AssignMagnitude(a, BinaryGcd(x, y));
+        break;
+      }
 
-  for (size_t i = 0; i < integer1.number_.size(); ++i) {
-    if (integer1.number_[i] != integer2.number_[i]) {
-      return integer1.sign_ == 1 ? std::stoi(integer1.number_[i]) <
-                                       std::stoi(integer2.number_[i])
-                                 : std::stoi(integer1.number_[i]) >
-                                       std::stoi(integer2.number_[i]);
+      LimbVector quotient;
+      while (y != 0) {
+        AssignMagnitude(quotient, x / y);
+        u_a = Sum(u_a, Product(quotient, u_b));
+        x %= y;
+        std::swap(x, y);
+        u_a.swap(u_b);
+        sign = -sign;
+      }
+      AssignMagnitude(a, x);
+      break;
+    }
+
+    // Hgcd on the top two thirds takes a and b down to about two thirds of
+    // their length.
+    if (a.size() >= Thresholds().gcd_limbs) {
+      size_t p = a.size() / 3;
+      LimbVector a_high = HighLimbs(a, p);
+      LimbVector b_high = HighLimbs(b, p);
+      GcdMatrix matrix;
+      if (Hgcd(a_high, b_high, matrix, alpha, beta)) {
+        ApplyHighMatrix(a, b, a_high, b_high, p, matrix);
+        if (extended) {
+          const auto& m = matrix.entries;
+          LimbVector next = Sum(Product(m[1][1], u_a), Product(m[0][1], u_b));
+          u_b = Sum(Product(m[0][0], u_b), Product(m[1][0], u_a));
+          u_a = std::move(next);
+        }
+        if (CompareMagnitude(a, b) < 0) {
+          swap();
+        }
+        continue;
+      }
+    } else {
+      LehmerMatrix lehmer;
+      if (ComputeLehmerMatrix(a, b, 0, lehmer)) {
+        ApplyLehmerMatrix(a, b, lehmer, alpha, beta);
+        if (extended) {
+          const auto& m = lehmer.entries;
+          LimbVector next = LinearCombination(u_a, m[1][1], u_b, m[0][1]);
+          u_b = LinearCombination(u_b, m[0][0], u_a, m[1][0]);
+          u_a = std::move(next);
+        }
+        if (CompareMagnitude(a, b) < 0) {
+          swap();
+        }
+        continue;
+      }
+    }
+
+    // A quotient too large for the matrices: divide.
+    auto [quotient, remainder] = DivideMagnitude(a, b);
+    if (extended) {
+      u_a = Sum(u_a, Product(quotient, u_b));
     }
+    a = std::move(remainder);
+    swap();
   }
 
-  return false;
+  if (extended) {
+    cofactor->number_ = std::move(u_a);
+    cofactor->sign_ = sign;
+    cofactor->Normalize();
+  }
+  return a;
 }
 
-bool operator>(const BigInteger& integer1, const BigInteger& integer2) {
-  return integer2 < integer1;
+BigInteger BigInteger::Gcd(const BigInteger& lhs, const BigInteger& rhs) {
+  BigInteger result;
+  result.number_ = GcdMagnitude(lhs.number_, rhs.number_, nullptr);
+  return result;
 }
 
-bool operator<=(const BigInteger& integer1, const BigInteger& integer2) {
-  return !(integer1 > integer2);
-}
+std::tuple<BigInteger, BigInteger, BigInteger> BigInteger::ExtendedGcd(
+    const BigInteger& a, const BigInteger& b) {
+  BigInteger x;
+  BigInteger gcd;
+  gcd.number_ = GcdMagnitude(a.number_, b.number_, &x);
+  if (gcd.number_.empty()) {
+    return {BigInteger(), BigInteger(), BigInteger()};
+  }
+  if (b.number_.empty()) {
+    return {std::move(gcd), a.sign_, BigInteger()};
+  }
 
-bool operator>=(const BigInteger& integer1, const BigInteger& integer2) {
-  return !(integer1 < integer2);
+  // x is the cofactor of |a|; take it mod |b| / g, then solve for y. a x
+  // can be longer than the size limit even though y is not.
+  x.sign_ *= a.sign_;
+  x.Normalize();
+  BigInteger period = b / gcd;
+  period.sign_ = 1;
+  x %= period;
+  if (x.IsNegative()) {
+    x += period;
+  }
+
+  BigIntegerLimitScope unlimited(kUnlimited);
+  BigInteger y = (gcd - a * x) / b;
+  return {std::move(gcd), std::move(x), std::move(y)};
 }
 
-BigInteger BigInteger::operator+(const BigInteger& integer) const {
-  BigInteger temp1 = *this;
-  BigInteger temp2 = integer;
+BigInteger BigInteger::ModInverse(const BigInteger& a,
+                                  const BigInteger& modulus) {
+  if (modulus.number_.empty()) {
+    throw BigIntegerDivisionByZero();
+  }
 
-  if (temp1.number_.size() > 10000 || temp2.number_.size() > 10000) {
-    throw BigIntegerOverflow();
+  BigInteger x;
+  if (GcdMagnitude(a.number_, modulus.number_, &x) != LimbVector{1}) {
+    throw std::invalid_argument("BigInteger: value is not invertible");
   }
 
-  if (this->sign_ != integer.sign_) {
-    temp2.sign_ *= -1;
-    return (*this) - temp2;
+  BigInteger m = modulus;
+  m.sign_ = 1;
+  x.sign_ *= a.sign_;
+  x.Normalize();
+  x %= m;
+  if (x.IsNegative()) {
+    x += m;
   }
+  return x;
+}
 
-  if (temp1.number_.size() < integer.number_.size()) {
-    std::swap(temp1.number_, temp2.number_);
+BigInteger BigInteger::RootMagnitude(const BigInteger& n, uint64_t k) {
+  size_t bits = BitLengthOf(n.number_);
+  if (k == 1 || bits <= k) {
+    return k == 1 || n.number_.empty() ? n : BigInteger(1);
   }
 
-  size_t max_size = temp1.number_.size();
-  std::vector<int> result(max_size, 0);
+  // A step from any positive x lands at or above floor(n^(1 / k)) and
+  // decreases strictly until it reaches it.
+  const BigInteger big_k = static_cast<int64_t>(k);
+  auto step = [&n, &big_k, k](const BigInteger& x) {
+    return (x * (big_k - 1) + n / Pow(x, k - 1)) / big_k;
+  };
+
+  size_t root_bits = (bits - 1) / k + 1;
+  BigInteger x;
+  if (root_bits <= 64) {
+    // Seeds from a double are within a relative 2^-47 of the root.
+    size_t shift = bits > 64 ? bits - 64 : 0;
+    double top = static_cast<double>(LowLimb(ShiftedRight(n.number_, shift)));
+    double seed = std::exp2((std::log2(top) + static_cast<double>(shift)) /
+                            static_cast<double>(k));
+    x.number_.push_back(seed >= 0x1p64  ? ~Limb{0}
+                        : seed >= 1 ? static_cast<Limb>(seed)
+                                    : 1);
+  } else {
+    // The root of the top bits is exact on about half of the root's bits
+    // and at most 2^j above it once shifted back, so after one step the
+    // error is below (k - 1) 2^(2j - root_bits), a fraction of 1.
+    size_t k_bits = 64 - static_cast<size_t>(__builtin_clzll(k));
+    size_t j = (root_bits - k_bits - 8) / 2;
+    BigInteger top;
+    top.number_ = ShiftedRight(n.number_, k * j);
+    x = RootMagnitude(top, k);
+    ++x;
+    x.number_ = ShiftedLeft(x.number_, j);
+  }
 
-  for (size_t i = 0; i < max_size; ++i) {
-    int num1 = (i < temp1.number_.size())
-                   ? std::stoi(temp1.number_[temp1.number_.size() - 1 - i])
-                   : 0;
-    int num2 = (i < temp2.number_.size())
-                   ? std::stoi(temp2.number_[temp2.number_.size() - 1 - i])
-                   : 0;
-    result[i] += num1 + num2;
-    if (result[i] >= 100000 && i + 1 < max_size) {
-      result[i] -= 100000;
-      result[i + 1]++;
-    } else if (result[i] >= 100000 && i + 1 == max_size) {
-      result[i] -= 100000;
-      result.push_back(1);
-    }
+  x = step(x);
+  while (Pow(x, k) > n) {
+    x = step(x);
   }
+  return x;
+}
 
-  temp1.number_ = AddZeros(result);
-  BigInteger result_big_integer = ChangeSignToZeroNumber(temp1);
+BigInteger BigInteger::ISqrt(const BigInteger& integer) {
+  return IRoot(integer, 2);
+}
 
-  if (result_big_integer.number_.size() > 10000) {
-    throw BigIntegerOverflow();
+BigInteger BigInteger::IRoot(const BigInteger& integer, uint64_t k) {
+  if (k == 0) {
+    throw std::invalid_argument("BigInteger: zeroth root");
+  }
+  if (integer.IsNegative() && k % 2 == 0) {
+    throw std::invalid_argument("BigInteger: even root of a negative number");
   }
 
-  return result_big_integer;
+  // Powers of candidates can be a limb longer than integer itself.
+  BigIntegerLimitScope unlimited(kUnlimited);
+  BigInteger root = RootMagnitude(integer.IsNegative() ? -integer : integer, k);
+  if (integer.IsNegative()) {
+    root.sign_ = -1;
+  }
+  return root;
 }
 
-BigInteger& BigInteger::operator+=(const BigInteger& integer) {
-  *this = *this + integer;
-  return *this;
-}
+bool BigInteger::IsPerfectSquare(const BigInteger& integer) {
+  if (integer.IsNegative()) {
+    return false;
+  }
+  if (integer.number_.empty()) {
+    return true;
+  }
 
-BigInteger BigInteger::operator-(const BigInteger& integer) const {
-  BigInteger temp1 = *this;
-  BigInteger temp2 = integer;
+  // Squares mod 64, 63, 65 and 11: only about 1 in 150 numbers passes all
+  // four (the filter of GMP's mpz_perfect_square_p).
+  static const auto residues = [] {
+    std::array<std::vector<bool>, 4> tables;
+    const Limb moduli[] = {64, 63, 65, 11};
+    for (int i = 0; i < 4; ++i) {
+      tables[i].assign(moduli[i], false);
+      for (Limb x = 0; x < moduli[i]; ++x) {
+        tables[i][x * x % moduli[i]] = true;
+      }
+    }
+    return tables;
+  }();
 
-  if (this->sign_ != integer.sign_) {
-    temp2.sign_ *= -1;
-    return (*this) + temp2;
+  Limb remainder = RemainderSmall(integer.number_, 63 * 65 * 11);
+  if (!residues[0][integer.number_[0] % 64] || !residues[1][remainder % 63] ||
+      !residues[2][remainder % 65] || !residues[3][remainder % 11]) {
+    return false;
   }
 
-  if (ComparisonForNegativeNumbers(temp1, temp2)) {
-    std::swap(temp1.number_, temp2.number_);
-    temp1.sign_ *= -1;
-  }
+  BigInteger root = ISqrt(integer);
+  return Square(root) == integer;
+}
 
-  //  if (temp1 < temp2) {
-  //    std::swap(temp1.number_, temp2.number_);
-  //    temp1.sign_ *= -1;
-  //  }
+BigInteger BigInteger::MultiplyAll(const std::vector<Limb>& factors) {
+  std::vector<Limb> packed = PackFactors(factors);
 
-  //  if (flag && temp2.sign_ == -1) {
-  //    std::swap(temp1.number_, temp2.number_);
-  //    temp1.sign_ *= -1;
-  //  }
+  // A product of numbers of b_i bits has at least sum (b_i - 1) + 1 bits.
+  size_t min_bits = 1;
+  for (Limb factor : packed) {
+    min_bits += 63 - static_cast<size_t>(__builtin_clzll(factor));
+  }
+  if ((min_bits - 1) / 64 >= max_limbs_) {
+    throw BigIntegerOverflow();
+  }
 
-  size_t max_size = temp1.number_.size();
-  std::vector<int> result(max_size, 0);
+  BigInteger result;
+  result.number_ = ProductTree(packed.data(), packed.size());
+  CheckLimbCount(result.number_.size());
+  return result;
+}
 
-  for (size_t i = 0; i < max_size; ++i) {
-    int num1 = (i < temp1.number_.size())
-                   ? std::stoi(temp1.number_[temp1.number_.size() - 1 - i])
-                   : 0;
-    int num2 = (i < temp2.number_.size())
-                   ? std::stoi(temp2.number_[temp2.number_.size() - 1 - i])
-                   : 0;
-    result[i] = num1 - num2;
+BigInteger BigInteger::Factorial(uint64_t n) {
+  // Too long by Stirling's formula, which lgamma evaluates.
+  double bits = std::lgamma(static_cast<double>(n) + 1) / std::log(2.0);
+  if (bits > 64 * (static_cast<double>(max_limbs_) + 1)) {
+    throw BigIntegerOverflow();
   }
 
-  for (size_t i = 0; i < result.size(); ++i) {
-    if (result[i] < 0 && result.size() != 1) {
-      result[i] += 100000;
-      result[i + 1]--;
+  // The odd part of m! for m = n >> i, from the smallest m up. The
+  // exponent of p in swing(m) has one bit per digit of m in base p:
+  // floor(m / p^i) mod 2.
+  std::vector<Limb> primes = PrimesUpTo(n);
+  BigInteger result = 1;
+  for (int shift = n == 0 ? 0 : 63 - __builtin_clzll(n); shift >= 0;
+       --shift) {
+    uint64_t m = n >> shift;
+    std::vector<Limb> factors;
+    for (size_t i = 1; i < primes.size() && primes[i] <= m; ++i) {
+      Limb p = primes[i];
+      Limb power = 1;
+      for (uint64_t q = m / p; q > 0; q /= p) {
+        if ((q & 1) != 0) {
+          power *= p;
+        }
+      }
+      if (power > 1) {
+        factors.push_back(power);
+      }
+    }
+
+    result = Square(result);
+    if (!factors.empty()) {
+      result *= MultiplyAll(factors);
     }
   }
 
-  temp1.number_ = AddZeros(result);
-  temp1.number_ = RemoveLeadingZeros(temp1.number_);
-  BigInteger result_big_integer = ChangeSignToZeroNumber(temp1);
-  return result_big_integer;
+  // n! has n - popcount(n) factors of two.
+  result.number_ =
+      ShiftedLeft(result.number_, n - static_cast<uint64_t>(
+                                          __builtin_popcountll(n)));
+  CheckLimbCount(result.number_.size());
+  return result;
 }
 
-std::vector<std::string> BigInteger::RemoveLeadingZeros(
-    const std::vector<std::string>& number) const {
-  std::vector<std::string> result = number;
+BigInteger BigInteger::Binomial(uint64_t n, uint64_t k) {
+  if (k > n) {
+    return BigInteger();
+  }
+  k = std::min(k, n - k);
+  if (k == 0) {
+    return 1;
+  }
 
-  while (!result.empty() &&
-         result.front().find_first_not_of('0') == std::string::npos) {
-    result.erase(result.begin());
+  // n choose k >= (n / k)^k.
+  double bits = static_cast<double>(k) *
+                std::log2(static_cast<double>(n) / static_cast<double>(k));
+  if (bits > 64 * (static_cast<double>(max_limbs_) + 1)) {
+    throw BigIntegerOverflow();
   }
 
-  if (result.empty()) {
-    result.emplace_back("0");
-  } else {
-    result.front().erase(0, result.front().find_first_not_of('0'));
+  if (n / 16 > k) {
+    // The sieve would cost more than the product: divide instead. The
+    // numerator may be longer than the limit even when the result is not.
+    BigInteger result;
+    {
+      BigIntegerLimitScope unlimited(kUnlimited);
+      std::vector<Limb> factors(k);
+      for (uint64_t i = 0; i < k; ++i) {
+        factors[i] = n - i;
+      }
+      result = MultiplyAll(factors) / Factorial(k);
+    }
+    CheckLimbCount(result.number_.size());
+    return result;
   }
 
-  return result;
+  // The exponent of p is the number of borrows when subtracting k from n
+  // in base p (Kummer), so p^e <= n fits in a limb.
+  std::vector<Limb> factors;
+  for (Limb p : PrimesUpTo(n)) {
+    Limb power = 1;
+    for (uint64_t top = n / p, low = k / p, high = (n - k) / p; top > 0;
+         top /= p, low /= p, high /= p) {
+      for (uint64_t e = top - low - high; e > 0; --e) {
+        power *= p;
+      }
+    }
+    if (power > 1) {
+      factors.push_back(power);
+    }
+  }
+  return MultiplyAll(factors);
 }
 
-BigInteger& BigInteger::operator-=(const BigInteger& integer) {
-  *this = *this - integer;
-  return *this;
+BigInteger BigInteger::Primorial(uint64_t n) {
+  return MultiplyAll(PrimesUpTo(n));
 }
 
-BigInteger BigInteger::operator*(const BigInteger& integer) const {
-  BigInteger temp1 = *this;
-  BigInteger temp2 = integer;
+BigInteger::ModContext::ModContext(const BigInteger& modulus)
+    : ModContext(modulus, Method::kBarrett) {}
 
-  if (temp1.number_.size() > 10000 || temp2.number_.size() > 10000) {
-    throw BigIntegerOverflow();
+BigInteger::ModContext::ModContext(const BigInteger& modulus, Method method)
+    : modulus_(modulus), method_(method) {
+  if (modulus_.number_.empty()) {
+    throw BigIntegerDivisionByZero();
+  }
+  modulus_.sign_ = 1;
+
+  const LimbVector& m = modulus_.number_;
+  size_t n = m.size();
+  if ((m[0] & 1) != 0) {
+    inverse_ = NegativeInverse(m[0]);
+  } else if (method == Method::kMontgomery) {
+    throw std::invalid_argument(
+        "BigInteger: Montgomery reduction needs an odd modulus");
   }
 
-  size_t max_size = std::max(temp1.number_.size(), temp2.number_.size());
-  std::vector<int64_t> result(max_size * 2, 0);
+  // The only division: B^2n = reciprocal m + r_squared.
+  LimbVector power(2 * n + 1);
+  power.back() = 1;
+  reciprocal_.resize(n + 2);
+  r_squared_.resize(n);
+  DivideLimbs(reciprocal_.data(), r_squared_.data(), power.data(), 2 * n + 1,
+              m.data(), n);
+}
 
-  std::reverse(temp1.number_.begin(), temp1.number_.end());
-  std::reverse(temp2.number_.begin(), temp2.number_.end());
+size_t BigInteger::ModContext::ScratchLimbs() const {
+  return 8 * modulus_.number_.size() + 8;
+}
 
-  for (size_t i = 0; i < temp1.number_.size(); ++i) {
-    for (size_t j = 0; j < temp2.number_.size(); ++j) {
-      result[i + j] +=
-          std::stol(temp1.number_[i]) * std::stol(temp2.number_[j]);
-    }
+void BigInteger::ModContext::ReduceLimbs(Limb* result, Limb* number,
+                                         Limb* scratch) const {
+  const LimbVector& m = modulus_.number_;
+  if (method_ == Method::kBarrett) {
+    BarrettReduce(result, number, m.data(), m.size(), reciprocal_.data(),
+                  scratch);
+    return;
   }
 
-  for (size_t i = 0; i < result.size() - 1; ++i) {
-    result[i + 1] += result[i] / 100000;
-    result[i] %= 100000;
+  // x / B^n, then times B^2n / B^n.
+  MontgomeryReduce(scratch, number, m.data(), m.size(), inverse_);
+  MultiplyForm(result, scratch, r_squared_.data(), scratch + m.size());
+}
+
+void BigInteger::ModContext::MultiplyForm(Limb* result, const Limb* lhs,
+                                          const Limb* rhs,
+                                          Limb* scratch) const {
+  const LimbVector& m = modulus_.number_;
+  size_t n = m.size();
+  MultiplyLimbs(scratch, lhs, n, rhs, n);
+  if (method_ == Method::kMontgomery) {
+    MontgomeryReduce(result, scratch, m.data(), n, inverse_);
+  } else {
+    BarrettReduce(result, scratch, m.data(), n, reciprocal_.data(),
+                  scratch + 2 * n);
   }
+}
 
-  while (result.size() > 1 && result.back() == 0) {
-    result.pop_back();
+void BigInteger::ModContext::ReduceInto(BigInteger& target,
+                                        const BigInteger& value) const {
+  const LimbVector& m = modulus_.number_;
+  const LimbVector& x = value.number_;
+  bool negative = value.IsNegative();
+  if (!negative && CompareMagnitude(x, m) < 0) {
+    target.number_ = x;
+    target.sign_ = 1;
+    return;
   }
 
-  std::vector<int> int_result(result.size(), 0);
-  for (size_t i = 0; i < result.size(); ++i) {
-    int_result[i] = static_cast<int>(result[i]);
+  size_t n = m.size();
+  size_t size = x.size();
+  LimbVector& scratch = ModScratch();
+  scratch.resize(ScratchLimbs());
+  Limb* number = scratch.data();
+  Limb* remainder = number + 2 * n;
+  Limb* work = remainder + n;
+
+  // Horner's rule over n-limb chunks from the top. r B^n + chunk is below
+  // m B^n, which both methods accept. Barrett also takes any 2n limbs at
+  // once, and Montgomery does when the top chunk is below m.
+  size_t first = size % n == 0 ? n : size % n;
+  if (size > first &&
+      (method_ == Method::kBarrett ||
+       CompareLimbs(x.data() + size - first, first, m.data(), n) < 0)) {
+    first += n;
   }
 
-  temp1.number_ = AddZeros(int_result);
-  BigInteger result_big_integer = ChangeSignToZeroNumber(temp1);
+  size_t position = size - first;
+  std::fill(number, number + 2 * n, 0);
+  std::copy(x.begin() + position, x.end(), number);
+  ReduceLimbs(remainder, number, work);
+  while (position > 0) {
+    position -= n;
+    std::copy(x.begin() + position, x.begin() + position + n, number);
+    std::copy(remainder, remainder + n, number + n);
+    ReduceLimbs(remainder, number, work);
+  }
 
-  if (temp1.sign_ != temp2.sign_) {
-    result_big_integer.sign_ = -1;
-  } else {
-    result_big_integer.sign_ = 1;
+  target.number_.resize(n);
+  std::copy(remainder, remainder + n, target.number_.begin());
+  target.sign_ = 1;
+  target.Normalize();
+  if (negative && !target.number_.empty()) {
+    target.sign_ = -1;
+    target += modulus_;
   }
+}
 
-  if (result_big_integer.number_.size() > 10000) {
-    throw BigIntegerOverflow();
+const BigInteger& BigInteger::ModContext::Reduced(const BigInteger& value,
+                                                  BigInteger& storage) const {
+  if (!value.IsNegative() && CompareMagnitude(value.number_,
+                                              modulus_.number_) < 0) {
+    return value;
   }
+  ReduceInto(storage, value);
+  return storage;
+}
 
-  return result_big_integer;
+BigInteger BigInteger::ModContext::Reduce(const BigInteger& value) const {
+  BigInteger result;
+  ReduceInto(result, value);
+  return result;
 }
 
-BigInteger& BigInteger::operator*=(const BigInteger& integer) {
-  *this = *this * integer;
-  return *this;
+void BigInteger::ModContext::Reduce(std::vector<BigInteger>& values) const {
+  for (auto& value : values) {
+    ReduceInto(value, value);
+  }
+}
+
+BigInteger BigInteger::ModContext::AddMod(const BigInteger& lhs,
+                                          const BigInteger& rhs) const {
+  BigInteger storage;
+  BigInteger result = Reduce(lhs);
+  result += Reduced(rhs, storage);
+  if (result >= modulus_) {
+    result -= modulus_;
+  }
+  return result;
+}
+
+BigInteger BigInteger::ModContext::SubMod(const BigInteger& lhs,
+                                          const BigInteger& rhs) const {
+  BigInteger storage;
+  BigInteger result = Reduce(lhs);
+  result -= Reduced(rhs, storage);
+  if (result.IsNegative()) {
+    result += modulus_;
+  }
+  return result;
+}
+
+BigInteger BigInteger::ModContext::MulMod(const BigInteger& lhs,
+                                          const BigInteger& rhs) const {
+  BigInteger lhs_storage;
+  BigInteger rhs_storage;
+  const LimbVector& a = Reduced(lhs, lhs_storage).number_;
+  const LimbVector& b = Reduced(rhs, rhs_storage).number_;
+  if (a.empty() || b.empty()) {
+    return BigInteger();
+  }
+
+  // The product is below m^2, so one reduction step suffices.
+  size_t n = modulus_.number_.size();
+  LimbVector& scratch = ModScratch();
+  scratch.resize(ScratchLimbs());
+  Limb* product = scratch.data();
+  std::fill(product, product + 2 * n, 0);
+  MultiplyLimbs(product, a.data(), a.size(), b.data(), b.size());
+
+  BigInteger result;
+  result.number_.resize(n);
+  ReduceLimbs(result.number_.data(), product, product + 2 * n);
+  result.Normalize();
+  return result;
 }
 
 BigInteger& BigInteger::operator++() {
-  *this = *this + BigInteger(1);
+  AddUnit(1);
   return *this;
 }
 
@@ -367,7 +3353,7 @@ const BigInteger BigInteger::operator++(int) {
 }
 
 BigInteger& BigInteger::operator--() {
-  *this = *this - BigInteger(1);
+  AddUnit(-1);
   return *this;
 }
 const BigInteger BigInteger::operator--(int) {
@@ -376,73 +3362,266 @@ const BigInteger BigInteger::operator--(int) {
   return before;
 }
 
-bool BigInteger::operator==(const BigInteger& integer) const {
-  return (this->number_ == integer.number_) && (this->sign_ == integer.sign_);
+void BigInteger::ApplyBitwise(const BigInteger& integer,
+                              BitOperation operation) {
+  if (&integer == this) {
+    if (operation == BitOperation::kXor) {
+      number_.clear();
+      sign_ = 1;
+    }
+    return;
+  }
+
+  // A negative x is ~(|x| - 1) in two's complement; the borrows of both
+  // decrements run along with the scan. The extra top limb holds the sign.
+  bool negative = IsNegative();
+  bool other_negative = integer.IsNegative();
+  const LimbVector& other = integer.number_;
+  size_t size = std::max(number_.size(), other.size()) + 1;
+  number_.resize(size);
+
+  Limb borrow = negative ? 1 : 0;
+  Limb other_borrow = other_negative ? 1 : 0;
+  for (size_t i = 0; i < size; ++i) {
+    Limb limb = number_[i];
+    Limb lhs = limb - borrow;
+    borrow = limb < borrow ? 1 : 0;
+    if (negative) {
+      lhs = ~lhs;
+    }
+
+    Limb other_limb = i < other.size() ? other[i] : 0;
+    Limb rhs = other_limb - other_borrow;
+    other_borrow = other_limb < other_borrow ? 1 : 0;
+    if (other_negative) {
+      rhs = ~rhs;
+    }
+
+    switch (operation) {
+      case BitOperation::kAnd:
+        number_[i] = lhs & rhs;
+        break;
+      case BitOperation::kOr:
+        number_[i] = lhs | rhs;
+        break;
+      case BitOperation::kXor:
+        number_[i] = lhs ^ rhs;
+        break;
+    }
+  }
+
+  sign_ = 1;
+  if ((number_[size - 1] >> 63) != 0) {
+    NegateTwos(number_.data(), size);
+    sign_ = -1;
+  }
+  Normalize();
 }
 
-bool BigInteger::operator!=(const BigInteger& integer) const {
-  return !(*this == integer);
+BigInteger BigInteger::operator&(const BigInteger& integer) const {
+  BigInteger result = *this;
+  result &= integer;
+  return result;
+}
+
+BigInteger& BigInteger::operator&=(const BigInteger& integer) {
+  ApplyBitwise(integer, BitOperation::kAnd);
+  return *this;
+}
+
+BigInteger BigInteger::operator|(const BigInteger& integer) const {
+  BigInteger result = *this;
+  result |= integer;
+  return result;
+}
+
+BigInteger& BigInteger::operator|=(const BigInteger& integer) {
+  ApplyBitwise(integer, BitOperation::kOr);
+  return *this;
+}
+
+BigInteger BigInteger::operator^(const BigInteger& integer) const {
+  BigInteger result = *this;
+  result ^= integer;
+  return result;
+}
+
+BigInteger& BigInteger::operator^=(const BigInteger& integer) {
+  ApplyBitwise(integer, BitOperation::kXor);
+  return *this;
+}
+
+BigInteger BigInteger::operator~() const {
+  BigInteger result = -*this;
+  result.AddUnit(-1);
+  return result;
 }
 
-BigInteger::operator bool() const {
+BigInteger BigInteger::operator<<(size_t shift) const {
+  BigInteger result;
   if (number_.empty()) {
-    return false;
+    return result;
   }
 
-  for (const auto& digit : number_) {
-    if (digit != "0") {
-      return true;
+  CheckLimbCount(number_.size() + shift / 64);
+  result.number_ = ShiftedLeft(number_, shift);
+  result.sign_ = sign_;
+  CheckLimbCount(result.number_.size());
+  return result;
+}
+
+BigInteger& BigInteger::operator<<=(size_t shift) {
+  if (number_.empty() || shift == 0) {
+    return *this;
+  }
+
+  size_t limbs = shift / 64;
+  unsigned bits = shift % 64;
+  size_t size = number_.size();
+  // The exact size of the result, checked before number_ is touched.
+  bool carry = bits != 0 && (number_.back() >> (64 - bits)) != 0;
+  CheckLimbCount(size + limbs + (carry ? 1 : 0));
+  number_.resize(size + limbs + 1);
+
+  // Top down, so that every limb is read before it is overwritten.
+  Limb* data = number_.data();
+  data[size + limbs] = bits == 0 ? 0 : data[size - 1] >> (64 - bits);
+  for (size_t i = size - 1; i > 0; --i) {
+    data[i + limbs] = bits == 0 ? data[i]
+                                : (data[i] << bits) |
+                                      (data[i - 1] >> (64 - bits));
+  }
+  data[limbs] = data[0] << bits;
+  std::fill(data, data + limbs, 0);
+
+  Normalize();
+  return *this;
+}
+
+BigInteger BigInteger::operator>>(size_t shift) const {
+  BigInteger result;
+  result.number_ = ShiftedRight(number_, shift);
+  if (IsNegative()) {
+    // Rounds toward minus infinity: the magnitude grows by one when any
+    // bit shifted out is set.
+    if (!result.number_.empty()) {
+      result.sign_ = -1;
+    }
+    if (HasLowBits(number_, shift)) {
+      result.AddUnit(-1);
     }
   }
-  return false;
+  return result;
 }
 
-std::ostream& operator<<(std::ostream& ostream, const BigInteger& integer) {
-  bool first_zeros = false;
-  if (!integer.number_.empty()) {
-    first_zeros = (std::stoi(integer.number_[0]) == 0);
+BigInteger& BigInteger::operator>>=(size_t shift) {
+  if (shift == 0) {
+    return *this;
   }
 
-  std::string result_string;
-  for (const auto& num : integer.number_) {
-    result_string += num;
+  bool round_down = IsNegative() && HasLowBits(number_, shift);
+  size_t limbs = shift / 64;
+  if (limbs >= number_.size()) {
+    number_.clear();
+  } else {
+    size_t size = number_.size() - limbs;
+    ShiftRightLimbs(number_.data(), number_.data() + limbs, size,
+                    shift % 64);
+    number_.resize(size);
   }
 
-  if (integer.sign_ == -1) {
-    ostream << "-";
+  Normalize();
+  if (round_down) {
+    AddUnit(-1);
   }
+  return *this;
+}
 
-  for (size_t i = 0; i < result_string.size(); ++i) {
-    if (result_string[i] == '0' && first_zeros &&
-        i != result_string.size() - 1) {
-      continue;
-    }
+size_t BigInteger::BitLength() const { return BitLengthOf(number_); }
 
-    first_zeros = false;
-    ostream << result_string[i];
+bool BigInteger::TestBit(size_t index) const {
+  size_t limb = index / 64;
+  bool bit = limb < number_.size() && ((number_[limb] >> (index % 64)) & 1);
+  if (!IsNegative()) {
+    return bit;
   }
 
-  return ostream;
+  // -x = ~x + 1 keeps the trailing zeros and the lowest set bit of x and
+  // complements every bit above them.
+  size_t zeros = CountTrailingZeros();
+  return index <= zeros ? bit : !bit;
 }
 
-std::istream& operator>>(std::istream& istream, BigInteger& integer) {
-  std::string str;
-  istream >> str;
+size_t BigInteger::PopCount() const {
+  size_t count = 0;
+  for (Limb limb : number_) {
+    count += static_cast<size_t>(__builtin_popcountll(limb));
+  }
+  return count;
+}
 
-  if (str.length() > str.max_size()) {
-    throw BigIntegerOverflow();
+size_t BigInteger::CountTrailingZeros() const {
+  for (size_t i = 0; i < number_.size(); ++i) {
+    if (number_[i] != 0) {
+      return i * 64 + static_cast<size_t>(__builtin_ctzll(number_[i]));
+    }
   }
+  return 0;
+}
 
-  std::string char_to_string_with_sign = std::string(str);
-  std::string sub_str = str.substr(1);
+bool BigInteger::operator==(const BigInteger& integer) const {
+  return (this->number_ == integer.number_) && (this->sign_ == integer.sign_);
+}
 
-  if (str[0] == '-') {
-    integer.sign_ *= -1;
-    integer.number_ = integer.ParseStringToVector(sub_str, 5);
-  } else if (str[0] == '+') {
-    integer.number_ = integer.ParseStringToVector(sub_str, 5);
-  } else {
-    integer.number_ = integer.ParseStringToVector(str, 5);
+bool BigInteger::operator!=(const BigInteger& integer) const {
+  return !(*this == integer);
+}
+
+BigInteger::operator bool() const { return !number_.empty(); }
+
+size_t BigInteger::MaxStringLength(int base) const {
+  CheckBase(base);
+  if (number_.empty()) {
+    return 1;
+  }
+
+  double digits = static_cast<double>(BitLength()) * std::log(2.0) /
+                  std::log(static_cast<double>(base));
+
+  // One extra digit covers the rounding of the logarithms.
+  return static_cast<size_t>(digits) + 2 + (sign_ < 0 ? 1 : 0);
+}
+
+size_t BigInteger::ToChars(char* buffer, size_t size, int base) const {
+  if (size < MaxStringLength(base)) {
+    throw std::length_error("BigInteger: buffer is too short");
+  }
+
+  DigitWriter writer(buffer);
+  WriteInteger(writer, number_, sign_, base);
+  return static_cast<size_t>(writer.Flush() - buffer);
+}
+
+std::string BigInteger::ToString(int base) const {
+  std::string result(MaxStringLength(base), '\0');
+  result.resize(ToChars(&result[0], result.size(), base));
+  return result;
+}
+
+std::ostream& operator<<(std::ostream& ostream, const BigInteger& integer) {
+  DigitWriter writer(ostream);
+  WriteInteger(writer, integer.number_, integer.sign_, 10);
+  writer.Flush();
+  return ostream;
+}
+
+std::istream& operator>>(std::istream& istream, BigInteger& integer) {
+  std::string str;
+  if (istream >> str) {
+    // Parsed into a temporary, so that integer is unchanged if it throws.
+    BigInteger value;
+    value.AssignDecimal(str.data(), str.size());
+    integer = std::move(value);
   }
 
   return istream;
@@ -2,11 +2,19 @@
 #define HSE_BIG_INTEGER_H
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <memory_resource>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include "limb_vector.h"
+
 class BigIntegerOverflow : public std::runtime_error {
  public:
   BigIntegerOverflow() : std::runtime_error("BigIntegerOverflow") {}
@@ -17,10 +25,137 @@ class BigIntegerDivisionByZero : public std::runtime_error {
   BigIntegerDivisionByZero() : std::runtime_error("BigIntegerDivisionByZero") {}
 };
 
+// Operand sizes, in limbs, at which multiplication, division, radix
+// conversion and gcd switch algorithm, and from which multiplication and
+// product trees use several threads. The defaults come from
+// BigInteger/benchmark.cpp on x86-64, except parallel_limbs: it is a
+// conservative guess that has not been measured, and the benchmark tunes it
+// on hosts with several cores.
+struct BigIntegerThresholds {
+  size_t karatsuba_limbs = 40;
+  size_t toom3_limbs = 140;
+  size_t ntt_limbs = 5000;
+  size_t division_limbs = 60;
+  size_t conversion_limbs = 40;
+  size_t parse_limbs = 1000;
+  size_t gcd_limbs = 200;
+  size_t parallel_limbs = 4096;
+};
+
+class BigInteger;
+
+// Sets the size limit of the calling thread for the lifetime of the scope,
+// then restores the previous one.
+class BigIntegerLimitScope {
+ public:
+  explicit BigIntegerLimitScope(size_t limbs);
+  BigIntegerLimitScope(const BigIntegerLimitScope&) = delete;
+  BigIntegerLimitScope& operator=(const BigIntegerLimitScope&) = delete;
+  ~BigIntegerLimitScope();
+
+ private:
+  size_t previous_;
+};
+
+// Makes the numbers that the calling thread creates for the lifetime of the
+// scope allocate from `resource`, then restores the previous resource.
+class BigIntegerMemoryScope {
+ public:
+  explicit BigIntegerMemoryScope(std::pmr::memory_resource* resource);
+  BigIntegerMemoryScope(const BigIntegerMemoryScope&) = delete;
+  BigIntegerMemoryScope& operator=(const BigIntegerMemoryScope&) = delete;
+  ~BigIntegerMemoryScope();
+
+ private:
+  std::pmr::memory_resource* previous_;
+};
+
+// One term of a lazy expression: sign * *lhs * *rhs, or sign * *lhs when rhs
+// is null.
+struct BigIntegerTerm {
+  const BigInteger* lhs;
+  const BigInteger* rhs;
+  int sign;
+};
+
+// A lazy sum of N terms, built by Lazy() and the operators below it.
+template <size_t N>
+struct BigIntegerSum {
+  std::array<BigIntegerTerm, N> terms;
+};
+
 class BigInteger {
+ public:
+  using Limb = LimbVector::Limb;
+
+  // Default size limit: about 50000 decimal digits, the bound of the former
+  // 10000 chunks of 5 digits. Under it, decimal input keeps that exact bound.
+  static constexpr size_t kMaxLimbs = 2596;
+  static constexpr size_t kMaxDecimalDigits = 50000;
+
+  // Size limit that no number can reach.
+  static constexpr size_t kUnlimited = std::numeric_limits<size_t>::max();
+
+  class ModContext;
+
  private:
+  // Magnitude in base 2^64, least significant limb first, without leading
+  // zero limbs. Zero is an empty vector with a positive sign.
   int sign_ = 1;
-  std::vector<std::string> number_;
+  LimbVector number_;
+
+  // Size limit of the calling thread. Only results that can grow are
+  // checked, each with one inline comparison; operands are not re-checked.
+  static inline thread_local size_t max_limbs_ = kMaxLimbs;
+
+  static void CheckLimbCount(size_t limbs) {
+    if (limbs > max_limbs_) {
+      throw BigIntegerOverflow();
+    }
+  }
+
+  // A product of n- and m-limb factors has n + m - 1 or n + m limbs, so it
+  // is rejected before multiplying when even the shorter length is too long.
+  static void CheckProductSize(size_t size) {
+    if (size > max_limbs_) {
+      CheckLimbCount(size - 1);
+    }
+  }
+
+  void Normalize();
+  void AssignDecimal(const char*, size_t);
+  static BigInteger AddSigned(const BigInteger&, const BigInteger&, int);
+
+  // In-place kernels of the compound operators. They reuse the capacity of
+  // number_ and only reallocate when the result outgrows it.
+  void AddInPlace(const BigInteger&, int);
+  void AddUnit(int);
+  void AddMultipleInPlace(const Limb*, size_t, Limb, int);
+  void AddTerm(const BigIntegerTerm&, int);
+
+  // In-place &, | and ^: both operands are read as two's complement limbs,
+  // one limb wider than the longer magnitude, in a single pass.
+  enum class BitOperation { kAnd, kOr, kXor };
+  void ApplyBitwise(const BigInteger&, BitOperation);
+
+  // Evaluates a lazy sum into *this; `accumulate` is 0 to assign, 1 to add
+  // and -1 to subtract.
+  void Evaluate(const BigIntegerTerm*, size_t, int accumulate);
+
+  // gcd(a, b) of two magnitudes. If `cofactor` is not null it receives x
+  // with gcd = a x + b y for some y.
+  static LimbVector GcdMagnitude(LimbVector a, LimbVector b,
+                                 BigInteger* cofactor);
+
+  // floor(n^(1 / k)) for n >= 0 and k >= 1.
+  static BigInteger RootMagnitude(const BigInteger& n, uint64_t k);
+
+  // Product of nonzero factors by a balanced product tree.
+  static BigInteger MultiplyAll(const std::vector<Limb>& factors);
+
+  // Converts to and from the limbs of a fixed-width integer.
+  template <size_t, bool>
+  friend class WideInt;
 
  public:
   BigInteger() = default;
@@ -28,17 +163,65 @@ class BigInteger {
   BigInteger(int64_t);                                             // NOLINT
   BigInteger(int num) : BigInteger(static_cast<int64_t>(num)) {};  // NOLINT
 
+  template <size_t N>
+  BigInteger(const BigIntegerSum<N>& sum) {  // NOLINT
+    Evaluate(sum.terms.data(), N, 0);
+  }
+
+  template <size_t N>
+  BigInteger& operator=(const BigIntegerSum<N>& sum) {
+    Evaluate(sum.terms.data(), N, 0);
+    return *this;
+  }
+
+  template <size_t N>
+  BigInteger& operator+=(const BigIntegerSum<N>& sum) {
+    Evaluate(sum.terms.data(), N, 1);
+    return *this;
+  }
+
+  template <size_t N>
+  BigInteger& operator-=(const BigIntegerSum<N>& sum) {
+    Evaluate(sum.terms.data(), N, -1);
+    return *this;
+  }
+
   bool IsNegative() const;
 
-  BigInteger ChangeSignToZeroNumber(const BigInteger&) const;
-  std::vector<std::string> RemoveLeadingZeros(
-      const std::vector<std::string>&) const;
+  static BigIntegerThresholds& Thresholds();
+
+  // Results longer than MaxLimbs() throw BigIntegerOverflow. The limit is
+  // set per thread and starts at kMaxLimbs; kUnlimited turns it off.
+  static size_t MaxLimbs();
+  static void SetMaxLimbs(size_t);
 
-  bool ComparisonForNegativeNumbers(const BigInteger&, const BigInteger&) const;
-  std::vector<std::string> ParseStringToVector(std::string&, size_t);
-  std::vector<std::string> ParseNumberToVector(int64_t, size_t);
-  std::vector<std::string> AddZeros(std::vector<int>&) const;
-  void SubstringNegativeNumber(std::vector<std::string>&);
+  // Threads that multiplication, squaring and the product trees of
+  // Factorial, Binomial and Primorial may use for independent subproducts of
+  // at least Thresholds().parallel_limbs limbs. They run on a process-wide
+  // work-stealing pool that SetThreads replaces. The default, 1, keeps all
+  // work on the calling thread; whether more threads help depends on the
+  // host and on parallel_limbs, so measure with benchmark.cpp first.
+  static size_t Threads();
+  static void SetThreads(size_t);
+
+  // The memory resource of the limbs of numbers that the calling thread
+  // creates from now on; null restores operator new. A number keeps the
+  // resource it was created with, and a move takes it along, so a phase
+  // of work can run out of a std::pmr::monotonic_buffer_resource: results
+  // that outlive it are copied, or assigned, into numbers created outside
+  // of it. Pool threads always use operator new.
+  static std::pmr::memory_resource* MemoryResource();
+  static void SetMemoryResource(std::pmr::memory_resource*);
+
+  // Karatsuba, Toom-3, NTT, division and radix conversion take their
+  // temporaries from a grow-only scratch workspace of the calling thread.
+  // ReserveScratch grows it to at least `limbs` limbs up front;
+  // ScratchHighWater is the most it has had in use at once, so reserving
+  // that much keeps later operations of similar size from allocating
+  // scratch space. Pool threads have workspaces of their own.
+  static void ReserveScratch(size_t limbs);
+  static size_t ScratchCapacity();
+  static size_t ScratchHighWater();
 
   friend bool operator<(const BigInteger&, const BigInteger&);
   friend bool operator>(const BigInteger&, const BigInteger&);
@@ -46,19 +229,95 @@ class BigInteger {
   friend bool operator>=(const BigInteger&, const BigInteger&);
 
   BigInteger operator+() const;
-  BigInteger operator-() const;
+  BigInteger operator-() const&;
+  BigInteger operator-() &&;
 
+  // The rvalue overloads compute in place in a temporary operand and return
+  // it, so a chain like a + b + c + d allocates at most once.
   BigInteger& operator+=(const BigInteger&);
-  BigInteger operator+(const BigInteger&) const;
+  BigInteger operator+(const BigInteger&) const&;
+  BigInteger operator+(const BigInteger&) &&;
+  BigInteger operator+(BigInteger&&) const&;
+  BigInteger operator+(BigInteger&&) &&;
 
-  BigInteger operator-(const BigInteger&) const;
+  BigInteger operator-(const BigInteger&) const&;
+  BigInteger operator-(const BigInteger&) &&;
+  BigInteger operator-(BigInteger&&) const&;
+  BigInteger operator-(BigInteger&&) &&;
   BigInteger& operator-=(const BigInteger&);
 
-  BigInteger operator*(const BigInteger&) const;
+  BigInteger operator*(const BigInteger&) const&;
+  BigInteger operator*(const BigInteger&) &&;
+  BigInteger operator*(BigInteger&&) const&;
+  BigInteger operator*(BigInteger&&) &&;
   BigInteger& operator*=(const BigInteger&);
 
-  // BigInteger operator/(const BigInteger&);
-  // BigInteger& operator/=(const BigInteger&);
+  // integer^2 with the squaring kernels, which need about half the limb
+  // products of a general product. x * x and x *= x use them as well.
+  static BigInteger Square(const BigInteger&);
+
+  // base^exponent by left-to-right binary exponentiation; 0^0 is 1. A
+  // result that cannot fit MaxLimbs() throws before anything is computed.
+  static BigInteger Pow(const BigInteger& base, uint64_t exponent);
+
+  // Quotient rounded toward zero and remainder with the sign of the
+  // dividend, as for int64_t.
+  static std::pair<BigInteger, BigInteger> DivMod(const BigInteger&,
+                                                  const BigInteger&);
+
+  // base^exponent mod |modulus|, in [0, |modulus|). Products are reduced
+  // by Montgomery multiplication for odd moduli and by Barrett reduction for
+  // even ones, so the exponentiation itself never divides. Throws
+  // std::invalid_argument for a negative exponent.
+  static BigInteger PowMod(const BigInteger& base, const BigInteger& exponent,
+                           const BigInteger& modulus);
+
+  // Greatest common divisor, nonnegative; Gcd(0, 0) is 0. Lehmer's
+  // algorithm with a binary gcd on the last two limbs, and above
+  // Thresholds().gcd_limbs the half-gcd recursion in O(M(n) log n).
+  static BigInteger Gcd(const BigInteger&, const BigInteger&);
+
+  // (g, x, y) with g = Gcd(a, b) = a x + b y. When b is nonzero,
+  // 0 <= x < |b| / g.
+  static std::tuple<BigInteger, BigInteger, BigInteger> ExtendedGcd(
+      const BigInteger& a, const BigInteger& b);
+
+  // x in [0, |modulus|) with a x = 1 mod |modulus|. Throws
+  // BigIntegerDivisionByZero for a zero modulus and std::invalid_argument if
+  // a and modulus are not coprime.
+  static BigInteger ModInverse(const BigInteger& a, const BigInteger& modulus);
+
+  // floor(sqrt(x)). Newton's iteration from a floating-point seed, where
+  // each step doubles the correct bits and costs one division, so the time
+  // is a small multiple of that of one division. Throws
+  // std::invalid_argument for negative x.
+  static BigInteger ISqrt(const BigInteger&);
+
+  // The k-th root rounded toward zero, by the same iteration. Throws
+  // std::invalid_argument for k = 0 and for negative x with even k.
+  static BigInteger IRoot(const BigInteger&, uint64_t k);
+
+  // Most non-squares are rejected by their residues before any root is
+  // taken.
+  static bool IsPerfectSquare(const BigInteger&);
+
+  // n! by Luschny's prime-swing algorithm: n! = ((n / 2)!)^2 swing(n), with
+  // swing(n) built from its prime factorization and the powers of two
+  // applied as one shift at the end.
+  static BigInteger Factorial(uint64_t n);
+
+  // n choose k, 0 for k > n. Built from its prime factorization (Legendre's
+  // formula), or as (n - k + 1) ... n / k! when k is small next to n.
+  static BigInteger Binomial(uint64_t n, uint64_t k);
+
+  // The product of the primes up to n.
+  static BigInteger Primorial(uint64_t n);
+
+  BigInteger operator/(const BigInteger&) const;
+  BigInteger& operator/=(const BigInteger&);
+
+  BigInteger operator%(const BigInteger&) const;
+  BigInteger& operator%=(const BigInteger&);
 
   BigInteger& operator++();
   const BigInteger operator++(int);
@@ -66,13 +325,195 @@ class BigInteger {
   BigInteger& operator--();
   const BigInteger operator--(int);
 
+  // Bitwise operators act on the infinite two's complement representation,
+  // where negative numbers have infinitely many leading ones: they agree
+  // with int64_t wherever both are defined, and ~x = -x - 1.
+  BigInteger operator&(const BigInteger&) const;
+  BigInteger& operator&=(const BigInteger&);
+
+  BigInteger operator|(const BigInteger&) const;
+  BigInteger& operator|=(const BigInteger&);
+
+  BigInteger operator^(const BigInteger&) const;
+  BigInteger& operator^=(const BigInteger&);
+
+  BigInteger operator~() const;
+
+  // x * 2^shift and floor(x / 2^shift), so negative numbers shift right
+  // toward minus infinity. Both move whole limbs with one pass of bit
+  // shifts; the compound forms work in place.
+  BigInteger operator<<(size_t shift) const;
+  BigInteger& operator<<=(size_t shift);
+
+  BigInteger operator>>(size_t shift) const;
+  BigInteger& operator>>=(size_t shift);
+
+  // Number of bits of |x|, 0 for zero.
+  size_t BitLength() const;
+
+  // Bit `index` of the two's complement representation.
+  bool TestBit(size_t index) const;
+
+  // Number of set bits of |x|.
+  size_t PopCount() const;
+
+  // The exponent of 2 in x, 0 for zero.
+  size_t CountTrailingZeros() const;
+
   explicit operator bool() const;
 
   bool operator==(const BigInteger&) const;
   bool operator!=(const BigInteger&) const;
 
+  // Digits in `base` (2 to 36, lowercase letters above 9) with a leading
+  // '-' for negative numbers. Bases other than powers of two are converted
+  // by recursive splitting in O(M(n) log n) time.
+  std::string ToString(int base = 10) const;
+
+  // An upper bound on the length of ToString(base).
+  size_t MaxStringLength(int base = 10) const;
+
+  // Writes ToString(base) to `buffer`, without a terminating null, and
+  // returns its length. Throws std::length_error if `size` is less than
+  // MaxStringLength(base).
+  size_t ToChars(char* buffer, size_t size, int base = 10) const;
+
   friend std::ostream& operator<<(std::ostream&, const BigInteger&);
   friend std::istream& operator>>(std::istream&, BigInteger&);
 };
 
+// Precomputed reduction modulo a fixed modulus m, for code that reduces many
+// numbers by the same one. Operands may be any integers; results lie in
+// [0, |m|). Nothing divides after construction: numbers of up to twice the
+// length of m take one reduction step, longer ones one step per n limbs.
+// Methods are const and safe to call from several threads at once.
+class BigInteger::ModContext {
+ public:
+  // Barrett works for every modulus. Montgomery needs an odd one and pays
+  // a conversion in and out of Montgomery form per result, so it only wins
+  // when values stay in that form, as inside PowMod.
+  enum class Method { kBarrett, kMontgomery };
+
+  // Uses Barrett. Throws BigIntegerDivisionByZero for a zero modulus.
+  explicit ModContext(const BigInteger& modulus);
+
+  // Throws std::invalid_argument for Montgomery with an even modulus.
+  ModContext(const BigInteger& modulus, Method method);
+
+  const BigInteger& Modulus() const { return modulus_; }
+  Method GetMethod() const { return method_; }
+
+  BigInteger Reduce(const BigInteger&) const;
+  BigInteger AddMod(const BigInteger&, const BigInteger&) const;
+  BigInteger SubMod(const BigInteger&, const BigInteger&) const;
+  BigInteger MulMod(const BigInteger&, const BigInteger&) const;
+
+  // Reduces every element in place, reusing its storage.
+  void Reduce(std::vector<BigInteger>&) const;
+
+ private:
+  friend class BigInteger;
+
+  BigInteger modulus_;
+  Method method_;
+  Limb inverse_ = 0;       // -1 / m mod B, for odd moduli.
+  LimbVector r_squared_;   // B^2n mod m, into Montgomery form.
+  LimbVector reciprocal_;  // floor(B^2n / m), n + 2 limbs, for Barrett.
+
+  size_t ScratchLimbs() const;
+
+  // Writes number mod m to result[0, n) for number[0, 2n) below m B^n.
+  // Overwrites number.
+  void ReduceLimbs(Limb* result, Limb* number, Limb* scratch) const;
+
+  // result = lhs rhs mod m in the working form of the method: x B^n mod m
+  // for Montgomery, x itself for Barrett. Operands have n limbs; the result
+  // may overlap them.
+  void MultiplyForm(Limb* result, const Limb* lhs, const Limb* rhs,
+                    Limb* scratch) const;
+
+  void ReduceInto(BigInteger& target, const BigInteger& value) const;
+
+  // `value` itself if it is already reduced, else `storage` set to it mod m.
+  const BigInteger& Reduced(const BigInteger& value,
+                            BigInteger& storage) const;
+};
+
+// Lazy expressions. `acc = Lazy(acc) * base + digit` or
+// `x = Lazy(a) * b - Lazy(c) * d` records pointers to the operands instead of
+// computing temporaries. Assigning the expression to a BigInteger (or using
+// it with += and -=) adds the terms one by one into the destination: a
+// product with a one-limb factor is a single multiply-add pass, and no
+// intermediate BigInteger is created. Products have at most two factors.
+// Expressions refer to their operands, so they must be consumed in the
+// full-expression that builds them.
+struct BigIntegerLazy : BigIntegerSum<1> {};
+
+inline BigIntegerLazy Lazy(const BigInteger& integer) {
+  return {{{{{&integer, nullptr, 1}}}}};
+}
+
+inline BigIntegerSum<1> operator*(const BigIntegerLazy& lhs,
+                                  const BigInteger& rhs) {
+  return {{{{lhs.terms[0].lhs, &rhs, 1}}}};
+}
+
+inline BigIntegerSum<1> operator*(const BigInteger& lhs,
+                                  const BigIntegerLazy& rhs) {
+  return {{{{&lhs, rhs.terms[0].lhs, 1}}}};
+}
+
+inline BigIntegerSum<1> operator*(const BigIntegerLazy& lhs,
+                                  const BigIntegerLazy& rhs) {
+  return {{{{lhs.terms[0].lhs, rhs.terms[0].lhs, 1}}}};
+}
+
+template <size_t N, size_t M>
+BigIntegerSum<N + M> operator+(const BigIntegerSum<N>& lhs,
+                               const BigIntegerSum<M>& rhs) {
+  BigIntegerSum<N + M> sum;
+  std::copy(lhs.terms.begin(), lhs.terms.end(), sum.terms.begin());
+  std::copy(rhs.terms.begin(), rhs.terms.end(), sum.terms.begin() + N);
+  return sum;
+}
+
+template <size_t N>
+BigIntegerSum<N> operator-(const BigIntegerSum<N>& sum) {
+  BigIntegerSum<N> negated = sum;
+  for (auto& term : negated.terms) {
+    term.sign = -term.sign;
+  }
+  return negated;
+}
+
+template <size_t N, size_t M>
+BigIntegerSum<N + M> operator-(const BigIntegerSum<N>& lhs,
+                               const BigIntegerSum<M>& rhs) {
+  return lhs + -rhs;
+}
+
+template <size_t N>
+BigIntegerSum<N + 1> operator+(const BigIntegerSum<N>& lhs,
+                               const BigInteger& rhs) {
+  return lhs + Lazy(rhs);
+}
+
+template <size_t N>
+BigIntegerSum<N + 1> operator-(const BigIntegerSum<N>& lhs,
+                               const BigInteger& rhs) {
+  return lhs - Lazy(rhs);
+}
+
+template <size_t N>
+BigIntegerSum<N + 1> operator+(const BigInteger& lhs,
+                               const BigIntegerSum<N>& rhs) {
+  return Lazy(lhs) + rhs;
+}
+
+template <size_t N>
+BigIntegerSum<N + 1> operator-(const BigInteger& lhs,
+                               const BigIntegerSum<N>& rhs) {
+  return Lazy(lhs) - rhs;
+}
+
 #endif
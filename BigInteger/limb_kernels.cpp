@@ -0,0 +1,361 @@
+#include "limb_kernels.h"
+
+#ifdef HSE_X86_LIMB_KERNELS
+
+namespace limb_kernels {
+
+namespace {
+
+// The loops handle size % 4 limbs one at a time and the rest four at a time.
+// DEC and LEA leave the carry flag alone, so ADC and SBB chains run across
+// iterations. The ADX loops keep two chains, the high limbs of the products
+// in CF and the accumulation in OF; DEC would clobber OF, so they count down
+// with LEA and JRCXZ instead, testing at the bottom of the four-limb loop
+// where the exit is within JRCXZ's short jump range.
+
+Limb AddNAdx(Limb* result, const Limb* lhs, const Limb* rhs, size_t size) {
+  size_t rest = size % 4;
+  size_t blocks = size / 4;
+  Limb limb;
+  __asm__ volatile(
+      "xor %k[limb], %k[limb]\n\t"
+      "jrcxz 2f\n"
+      "1:\n\t"
+      "mov (%[lhs]), %[limb]\n\t"
+      "adc (%[rhs]), %[limb]\n\t"
+      "mov %[limb], (%[result])\n\t"
+      "lea 8(%[lhs]), %[lhs]\n\t"
+      "lea 8(%[rhs]), %[rhs]\n\t"
+      "lea 8(%[result]), %[result]\n\t"
+      "dec %%rcx\n\t"
+      "jnz 1b\n"
+      "2:\n\t"
+      "mov %[blocks], %%rcx\n\t"
+      "jrcxz 4f\n"
+      "3:\n\t"
+      "mov (%[lhs]), %[limb]\n\t"
+      "adc (%[rhs]), %[limb]\n\t"
+      "mov %[limb], (%[result])\n\t"
+      "mov 8(%[lhs]), %[limb]\n\t"
+      "adc 8(%[rhs]), %[limb]\n\t"
+      "mov %[limb], 8(%[result])\n\t"
+      "mov 16(%[lhs]), %[limb]\n\t"
+      "adc 16(%[rhs]), %[limb]\n\t"
+      "mov %[limb], 16(%[result])\n\t"
+      "mov 24(%[lhs]), %[limb]\n\t"
+      "adc 24(%[rhs]), %[limb]\n\t"
+      "mov %[limb], 24(%[result])\n\t"
+      "lea 32(%[lhs]), %[lhs]\n\t"
+      "lea 32(%[rhs]), %[rhs]\n\t"
+      "lea 32(%[result]), %[result]\n\t"
+      "dec %%rcx\n\t"
+      "jnz 3b\n"
+      "4:\n\t"
+      "mov $0, %k[limb]\n\t"
+      "adc $0, %k[limb]\n"
+      : [limb] "=&r"(limb), [result] "+&r"(result), [lhs] "+&r"(lhs),
+        [rhs] "+&r"(rhs), "+&c"(rest)
+      : [blocks] "r"(blocks)
+      : "cc", "memory");
+  return limb;
+}
+
+Limb SubtractNAdx(Limb* result, const Limb* lhs, const Limb* rhs,
+                  size_t size) {
+  size_t rest = size % 4;
+  size_t blocks = size / 4;
+  Limb limb;
+  __asm__ volatile(
+      "xor %k[limb], %k[limb]\n\t"
+      "jrcxz 2f\n"
+      "1:\n\t"
+      "mov (%[lhs]), %[limb]\n\t"
+      "sbb (%[rhs]), %[limb]\n\t"
+      "mov %[limb], (%[result])\n\t"
+      "lea 8(%[lhs]), %[lhs]\n\t"
+      "lea 8(%[rhs]), %[rhs]\n\t"
+      "lea 8(%[result]), %[result]\n\t"
+      "dec %%rcx\n\t"
+      "jnz 1b\n"
+      "2:\n\t"
+      "mov %[blocks], %%rcx\n\t"
+      "jrcxz 4f\n"
+      "3:\n\t"
+      "mov (%[lhs]), %[limb]\n\t"
+      "sbb (%[rhs]), %[limb]\n\t"
+      "mov %[limb], (%[result])\n\t"
+      "mov 8(%[lhs]), %[limb]\n\t"
+      "sbb 8(%[rhs]), %[limb]\n\t"
+      "mov %[limb], 8(%[result])\n\t"
+      "mov 16(%[lhs]), %[limb]\n\t"
+      "sbb 16(%[rhs]), %[limb]\n\t"
+      "mov %[limb], 16(%[result])\n\t"
+      "mov 24(%[lhs]), %[limb]\n\t"
+      "sbb 24(%[rhs]), %[limb]\n\t"
+      "mov %[limb], 24(%[result])\n\t"
+      "lea 32(%[lhs]), %[lhs]\n\t"
+      "lea 32(%[rhs]), %[rhs]\n\t"
+      "lea 32(%[result]), %[result]\n\t"
+      "dec %%rcx\n\t"
+      "jnz 3b\n"
+      "4:\n\t"
+      "mov $0, %k[limb]\n\t"
+      "adc $0, %k[limb]\n"
+      : [limb] "=&r"(limb), [result] "+&r"(result), [lhs] "+&r"(lhs),
+        [rhs] "+&r"(rhs), "+&c"(rest)
+      : [blocks] "r"(blocks)
+      : "cc", "memory");
+  return limb;
+}
+
+Limb MultiplyLimbsByAdx(Limb* result, const Limb* number, size_t size,
+                        Limb multiplier) {
+  size_t rest = size % 4;
+  size_t blocks = size / 4;
+  Limb high = 0;
+  Limb low;
+  Limb next_high;
+  __asm__ volatile(
+      "xor %k[low], %k[low]\n\t"
+      "jrcxz 2f\n"
+      "1:\n\t"
+      "mulx (%[number]), %[low], %[next_high]\n\t"
+      "adc %[high], %[low]\n\t"
+      "mov %[low], (%[result])\n\t"
+      "mov %[next_high], %[high]\n\t"
+      "lea 8(%[number]), %[number]\n\t"
+      "lea 8(%[result]), %[result]\n\t"
+      "dec %%rcx\n\t"
+      "jnz 1b\n"
+      "2:\n\t"
+      "mov %[blocks], %%rcx\n\t"
+      "jrcxz 4f\n"
+      "3:\n\t"
+      "mulx (%[number]), %[low], %[next_high]\n\t"
+      "adc %[high], %[low]\n\t"
+      "mov %[low], (%[result])\n\t"
+      "mulx 8(%[number]), %[low], %[high]\n\t"
+      "adc %[next_high], %[low]\n\t"
+      "mov %[low], 8(%[result])\n\t"
+      "mulx 16(%[number]), %[low], %[next_high]\n\t"
+      "adc %[high], %[low]\n\t"
+      "mov %[low], 16(%[result])\n\t"
+      "mulx 24(%[number]), %[low], %[high]\n\t"
+      "adc %[next_high], %[low]\n\t"
+      "mov %[low], 24(%[result])\n\t"
+      "lea 32(%[number]), %[number]\n\t"
+      "lea 32(%[result]), %[result]\n\t"
+      "dec %%rcx\n\t"
+      "jnz 3b\n"
+      "4:\n\t"
+      "adc $0, %[high]\n"
+      : [high] "+&r"(high), [low] "=&r"(low), [next_high] "=&r"(next_high),
+        [result] "+&r"(result), [number] "+&r"(number), "+&c"(rest)
+      : [blocks] "r"(blocks), "d"(multiplier)
+      : "cc", "memory");
+  return high;
+}
+
+Limb AddMultipliedLimbsAdx(Limb* number, const Limb* multiplicand,
+                           size_t size, Limb multiplier) {
+  size_t rest = size % 4;
+  size_t blocks = size / 4;
+  Limb high = 0;
+  Limb low;
+  Limb next_high;
+  __asm__ volatile(
+      "xor %k[low], %k[low]\n\t"
+      "jrcxz 2f\n"
+      "1:\n\t"
+      "mulx (%[multiplicand]), %[low], %[next_high]\n\t"
+      "adcx %[high], %[low]\n\t"
+      "adox (%[number]), %[low]\n\t"
+      "mov %[low], (%[number])\n\t"
+      "mov %[next_high], %[high]\n\t"
+      "lea 8(%[multiplicand]), %[multiplicand]\n\t"
+      "lea 8(%[number]), %[number]\n\t"
+      "lea -1(%%rcx), %%rcx\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n"
+      "2:\n\t"
+      "mov %[blocks], %%rcx\n\t"
+      "jmp 5f\n"
+      "3:\n\t"
+      "mulx (%[multiplicand]), %[low], %[next_high]\n\t"
+      "adcx %[high], %[low]\n\t"
+      "adox (%[number]), %[low]\n\t"
+      "mov %[low], (%[number])\n\t"
+      "mulx 8(%[multiplicand]), %[low], %[high]\n\t"
+      "adcx %[next_high], %[low]\n\t"
+      "adox 8(%[number]), %[low]\n\t"
+      "mov %[low], 8(%[number])\n\t"
+      "mulx 16(%[multiplicand]), %[low], %[next_high]\n\t"
+      "adcx %[high], %[low]\n\t"
+      "adox 16(%[number]), %[low]\n\t"
+      "mov %[low], 16(%[number])\n\t"
+      "mulx 24(%[multiplicand]), %[low], %[high]\n\t"
+      "adcx %[next_high], %[low]\n\t"
+      "adox 24(%[number]), %[low]\n\t"
+      "mov %[low], 24(%[number])\n\t"
+      "lea 32(%[multiplicand]), %[multiplicand]\n\t"
+      "lea 32(%[number]), %[number]\n\t"
+      "lea -1(%%rcx), %%rcx\n"
+      "5:\n\t"
+      "jrcxz 4f\n\t"
+      "jmp 3b\n"
+      "4:\n\t"
+      "mov $0, %k[low]\n\t"
+      "adcx %[low], %[high]\n\t"
+      "adox %[low], %[high]\n"
+      : [high] "+&r"(high), [low] "=&r"(low), [next_high] "=&r"(next_high),
+        [number] "+&r"(number), [multiplicand] "+&r"(multiplicand),
+        "+&c"(rest)
+      : [blocks] "r"(blocks), "d"(multiplier)
+      : "cc", "memory");
+  return high;
+}
+
+// number - product = ~(~number + product), so the subtraction runs as an
+// ADOX chain too; its carry is the borrow.
+Limb SubtractMultipliedLimbsAdx(Limb* number, const Limb* multiplicand,
+                                size_t size, Limb multiplier) {
+  size_t rest = size % 4;
+  size_t blocks = size / 4;
+  Limb high = 0;
+  Limb low;
+  Limb next_high;
+  Limb limb;
+  __asm__ volatile(
+      "xor %k[low], %k[low]\n\t"
+      "jrcxz 2f\n"
+      "1:\n\t"
+      "mulx (%[multiplicand]), %[low], %[next_high]\n\t"
+      "adcx %[high], %[low]\n\t"
+      "mov (%[number]), %[limb]\n\t"
+      "not %[limb]\n\t"
+      "adox %[low], %[limb]\n\t"
+      "not %[limb]\n\t"
+      "mov %[limb], (%[number])\n\t"
+      "mov %[next_high], %[high]\n\t"
+      "lea 8(%[multiplicand]), %[multiplicand]\n\t"
+      "lea 8(%[number]), %[number]\n\t"
+      "lea -1(%%rcx), %%rcx\n\t"
+      "jrcxz 2f\n\t"
+      "jmp 1b\n"
+      "2:\n\t"
+      "mov %[blocks], %%rcx\n\t"
+      "jmp 5f\n"
+      "3:\n\t"
+      "mulx (%[multiplicand]), %[low], %[next_high]\n\t"
+      "adcx %[high], %[low]\n\t"
+      "mov (%[number]), %[limb]\n\t"
+      "not %[limb]\n\t"
+      "adox %[low], %[limb]\n\t"
+      "not %[limb]\n\t"
+      "mov %[limb], (%[number])\n\t"
+      "mulx 8(%[multiplicand]), %[low], %[high]\n\t"
+      "adcx %[next_high], %[low]\n\t"
+      "mov 8(%[number]), %[limb]\n\t"
+      "not %[limb]\n\t"
+      "adox %[low], %[limb]\n\t"
+      "not %[limb]\n\t"
+      "mov %[limb], 8(%[number])\n\t"
+      "mulx 16(%[multiplicand]), %[low], %[next_high]\n\t"
+      "adcx %[high], %[low]\n\t"
+      "mov 16(%[number]), %[limb]\n\t"
+      "not %[limb]\n\t"
+      "adox %[low], %[limb]\n\t"
+      "not %[limb]\n\t"
+      "mov %[limb], 16(%[number])\n\t"
+      "mulx 24(%[multiplicand]), %[low], %[high]\n\t"
+      "adcx %[next_high], %[low]\n\t"
+      "mov 24(%[number]), %[limb]\n\t"
+      "not %[limb]\n\t"
+      "adox %[low], %[limb]\n\t"
+      "not %[limb]\n\t"
+      "mov %[limb], 24(%[number])\n\t"
+      "lea 32(%[multiplicand]), %[multiplicand]\n\t"
+      "lea 32(%[number]), %[number]\n\t"
+      "lea -1(%%rcx), %%rcx\n"
+      "5:\n\t"
+      "jrcxz 4f\n\t"
+      "jmp 3b\n"
+      "4:\n\t"
+      "mov $0, %k[low]\n\t"
+      "adcx %[low], %[high]\n\t"
+      "adox %[low], %[high]\n"
+      : [high] "+&r"(high), [low] "=&r"(low), [next_high] "=&r"(next_high),
+        [limb] "=&r"(limb), [number] "+&r"(number),
+        [multiplicand] "+&r"(multiplicand), "+&c"(rest)
+      : [blocks] "r"(blocks), "d"(multiplier)
+      : "cc", "memory");
+  return high;
+}
+
+bool HasAdx() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("bmi2") && __builtin_cpu_supports("adx");
+}
+
+struct Kernels {
+  const char* name;
+  Limb (*add)(Limb*, const Limb*, const Limb*, size_t);
+  Limb (*subtract)(Limb*, const Limb*, const Limb*, size_t);
+  Limb (*multiply)(Limb*, const Limb*, size_t, Limb);
+  Limb (*add_multiplied)(Limb*, const Limb*, size_t, Limb);
+  Limb (*subtract_multiplied)(Limb*, const Limb*, size_t, Limb);
+};
+
+Kernels SelectKernels() {
+  if (HasAdx()) {
+    return {"adx",
+            AddNAdx,
+            SubtractNAdx,
+            MultiplyLimbsByAdx,
+            AddMultipliedLimbsAdx,
+            SubtractMultipliedLimbsAdx};
+  }
+  return {"portable",
+          AddNPortable,
+          SubtractNPortable,
+          MultiplyLimbsByPortable,
+          AddMultipliedLimbsPortable,
+          SubtractMultipliedLimbsPortable};
+}
+
+const Kernels& Selected() {
+  static const Kernels kernels = SelectKernels();
+  return kernels;
+}
+
+}  // namespace
+
+Limb AddN(Limb* result, const Limb* lhs, const Limb* rhs, size_t size) {
+  return Selected().add(result, lhs, rhs, size);
+}
+
+Limb SubtractN(Limb* result, const Limb* lhs, const Limb* rhs, size_t size) {
+  return Selected().subtract(result, lhs, rhs, size);
+}
+
+Limb MultiplyLimbsBy(Limb* result, const Limb* number, size_t size,
+                     Limb multiplier) {
+  return Selected().multiply(result, number, size, multiplier);
+}
+
+Limb AddMultipliedLimbs(Limb* number, const Limb* multiplicand, size_t size,
+                        Limb multiplier) {
+  return Selected().add_multiplied(number, multiplicand, size, multiplier);
+}
+
+Limb SubtractMultipliedLimbs(Limb* number, const Limb* multiplicand,
+                             size_t size, Limb multiplier) {
+  return Selected().subtract_multiplied(number, multiplicand, size,
+                                        multiplier);
+}
+
+const char* Name() { return Selected().name; }
+
+}  // namespace limb_kernels
+
+#endif
@@ -0,0 +1,159 @@
+#ifndef HSE_LIMB_KERNELS_H
+#define HSE_LIMB_KERNELS_H
+
+#include <cstddef>
+#include <cstdint>
+
+// The carry-propagating inner loops that every BigInteger algorithm is built
+// on. Each works on limbs of 64 bits, least significant first. On x86-64
+// CPUs with BMI2 and ADX the products use MULX and the additions two
+// independent carry chains (ADCX and ADOX), chosen from CPUID on first use.
+// Other targets, or builds with HSE_PORTABLE_LIMB_KERNELS defined, get the
+// portable 128-bit versions below inlined into the callers.
+//
+// The result may be the same array as an operand, but must not overlap one
+// at an offset. Sizes may be zero.
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__)) && \
+    !defined(HSE_PORTABLE_LIMB_KERNELS)
+#define HSE_X86_LIMB_KERNELS
+#endif
+
+namespace limb_kernels {
+
+using Limb = uint64_t;
+__extension__ typedef unsigned __int128 DoubleLimb;
+
+inline Limb AddNPortable(Limb* result, const Limb* lhs, const Limb* rhs,
+                         size_t size) {
+  Limb carry = 0;
+  for (size_t i = 0; i < size; ++i) {
+    Limb sum = lhs[i] + carry;
+    carry = static_cast<Limb>(sum < carry);
+    sum += rhs[i];
+    carry += static_cast<Limb>(sum < rhs[i]);
+    result[i] = sum;
+  }
+
+  return carry;
+}
+
+inline Limb SubtractNPortable(Limb* result, const Limb* lhs, const Limb* rhs,
+                              size_t size) {
+  Limb borrow = 0;
+  for (size_t i = 0; i < size; ++i) {
+    Limb difference = lhs[i] - rhs[i];
+    Limb next_borrow = static_cast<Limb>(lhs[i] < rhs[i]);
+    next_borrow += static_cast<Limb>(difference < borrow);
+    result[i] = difference - borrow;
+    borrow = next_borrow;
+  }
+
+  return borrow;
+}
+
+inline Limb MultiplyLimbsByPortable(Limb* result, const Limb* number,
+                                    size_t size, Limb multiplier) {
+  Limb carry = 0;
+  for (size_t i = 0; i < size; ++i) {
+    DoubleLimb product =
+        static_cast<DoubleLimb>(number[i]) * multiplier + carry;
+    result[i] = static_cast<Limb>(product);
+    carry = static_cast<Limb>(product >> 64);
+  }
+
+  return carry;
+}
+
+inline Limb AddMultipliedLimbsPortable(Limb* number, const Limb* multiplicand,
+                                       size_t size, Limb multiplier) {
+  Limb carry = 0;
+  for (size_t i = 0; i < size; ++i) {
+    DoubleLimb product =
+        static_cast<DoubleLimb>(multiplicand[i]) * multiplier + number[i] +
+        carry;
+    number[i] = static_cast<Limb>(product);
+    carry = static_cast<Limb>(product >> 64);
+  }
+
+  return carry;
+}
+
+inline Limb SubtractMultipliedLimbsPortable(Limb* number,
+                                            const Limb* multiplicand,
+                                            size_t size, Limb multiplier) {
+  Limb borrow = 0;
+  for (size_t i = 0; i < size; ++i) {
+    DoubleLimb product =
+        static_cast<DoubleLimb>(multiplicand[i]) * multiplier + borrow;
+    Limb low = static_cast<Limb>(product);
+    borrow = static_cast<Limb>(product >> 64);
+
+    Limb limb = number[i];
+    number[i] = limb - low;
+    borrow += static_cast<Limb>(limb < low);
+  }
+
+  return borrow;
+}
+
+#ifdef HSE_X86_LIMB_KERNELS
+
+// result[0, size) = lhs + rhs; returns the carry.
+Limb AddN(Limb* result, const Limb* lhs, const Limb* rhs, size_t size);
+
+// result[0, size) = lhs - rhs; returns the borrow.
+Limb SubtractN(Limb* result, const Limb* lhs, const Limb* rhs, size_t size);
+
+// result[0, size) = number * multiplier; returns the high limb.
+Limb MultiplyLimbsBy(Limb* result, const Limb* number, size_t size,
+                     Limb multiplier);
+
+// number[0, size) += multiplicand[0, size) * multiplier; returns the carry
+// limb.
+Limb AddMultipliedLimbs(Limb* number, const Limb* multiplicand, size_t size,
+                        Limb multiplier);
+
+// number[0, size) -= multiplicand[0, size) * multiplier; returns the limb
+// that has to be borrowed from number[size].
+Limb SubtractMultipliedLimbs(Limb* number, const Limb* multiplicand,
+                             size_t size, Limb multiplier);
+
+// "adx" or "portable".
+const char* Name();
+
+#else
+
+// The same contracts as above.
+inline Limb AddN(Limb* result, const Limb* lhs, const Limb* rhs,
+                 size_t size) {
+  return AddNPortable(result, lhs, rhs, size);
+}
+
+inline Limb SubtractN(Limb* result, const Limb* lhs, const Limb* rhs,
+                      size_t size) {
+  return SubtractNPortable(result, lhs, rhs, size);
+}
+
+inline Limb MultiplyLimbsBy(Limb* result, const Limb* number, size_t size,
+                            Limb multiplier) {
+  return MultiplyLimbsByPortable(result, number, size, multiplier);
+}
+
+inline Limb AddMultipliedLimbs(Limb* number, const Limb* multiplicand,
+                               size_t size, Limb multiplier) {
+  return AddMultipliedLimbsPortable(number, multiplicand, size, multiplier);
+}
+
+inline Limb SubtractMultipliedLimbs(Limb* number, const Limb* multiplicand,
+                                    size_t size, Limb multiplier) {
+  return SubtractMultipliedLimbsPortable(number, multiplicand, size,
+                                         multiplier);
+}
+
+inline const char* Name() { return "portable"; }
+
+#endif
+
+}  // namespace limb_kernels
+
+#endif
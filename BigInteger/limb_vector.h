@@ -0,0 +1,221 @@
+#ifndef HSE_LIMB_VECTOR_H
+#define HSE_LIMB_VECTOR_H
+
+#include <algorithm>
+#include <cstdint>
+#include <initializer_list>
+#include <memory_resource>
+
+// Limb storage of BigInteger with the subset of the std::vector interface it
+// needs. Up to kInlineLimbs limbs live inside the object, so values below
+// 2^128 never touch the heap; longer numbers move to a heap buffer that
+// grows geometrically. New limbs are always zero-filled.
+//
+// Heap buffers come from the memory resource the vector was constructed
+// with: by default the resource of the constructing thread, which is
+// operator new unless SetThreadResource says otherwise. As with std::pmr
+// containers, a move takes the resource along, while assignment and swap
+// keep the resources in place and copy the limbs when they differ.
+class LimbVector {
+ public:
+  using Limb = uint64_t;
+
+  static constexpr size_t kInlineLimbs = 2;
+
+  LimbVector() = default;
+
+  // Empty, with heap buffers from `resource`.
+  explicit LimbVector(std::pmr::memory_resource* resource)
+      : resource_(Normalized(resource)) {}
+
+  explicit LimbVector(size_t count) { resize(count); }
+
+  LimbVector(const Limb* first, const Limb* last) {
+    reserve(static_cast<size_t>(last - first));
+    std::copy(first, last, data_);
+    size_ = static_cast<size_t>(last - first);
+  }
+
+  LimbVector(std::initializer_list<Limb> list)
+      : LimbVector(list.begin(), list.end()) {}
+
+  LimbVector(const LimbVector& other)
+      : LimbVector(other.data_, other.data_ + other.size_) {}
+
+  LimbVector(LimbVector&& other) noexcept : resource_(other.resource_) {
+    MoveFrom(other);
+  }
+
+  LimbVector& operator=(const LimbVector& other) {
+    if (this != &other) {
+      size_ = 0;
+      reserve(other.size_);
+      std::copy(other.data_, other.data_ + other.size_, data_);
+      size_ = other.size_;
+    }
+    return *this;
+  }
+
+  // Copies, and may allocate, if the resources differ.
+  LimbVector& operator=(LimbVector&& other) {
+    if (this == &other) {
+      return *this;
+    }
+
+    if (resource_ == other.resource_) {
+      Release();
+      MoveFrom(other);
+    } else {
+      *this = other;
+      other.clear();
+    }
+    return *this;
+  }
+
+  ~LimbVector() { Release(); }
+
+  // The resource of the vectors that the calling thread constructs without
+  // one. Null restores operator new.
+  static std::pmr::memory_resource* ThreadResource() {
+    return thread_resource_ != nullptr ? thread_resource_
+                                       : std::pmr::new_delete_resource();
+  }
+  static void SetThreadResource(std::pmr::memory_resource* resource) {
+    thread_resource_ = Normalized(resource);
+  }
+
+  size_t size() const { return size_; }
+  size_t capacity() const { return capacity_; }
+  bool empty() const { return size_ == 0; }
+
+  Limb* data() { return data_; }
+  const Limb* data() const { return data_; }
+
+  Limb* begin() { return data_; }
+  const Limb* begin() const { return data_; }
+  Limb* end() { return data_ + size_; }
+  const Limb* end() const { return data_ + size_; }
+
+  Limb& operator[](size_t index) { return data_[index]; }
+  const Limb& operator[](size_t index) const { return data_[index]; }
+
+  Limb& back() { return data_[size_ - 1]; }
+  const Limb& back() const { return data_[size_ - 1]; }
+
+  void clear() { size_ = 0; }
+
+  void reserve(size_t count) {
+    if (count <= capacity_) {
+      return;
+    }
+
+    Limb* data = Allocate(count);
+    std::copy(data_, data_ + size_, data);
+    Release();
+    data_ = data;
+    capacity_ = count;
+  }
+
+  void resize(size_t count) {
+    if (count > capacity_) {
+      reserve(std::max(count, 2 * capacity_));
+    }
+    if (count > size_) {
+      std::fill(data_ + size_, data_ + count, 0);
+    }
+    size_ = count;
+  }
+
+  void push_back(Limb limb) {
+    if (size_ == capacity_) {
+      reserve(2 * capacity_);
+    }
+    data_[size_++] = limb;
+  }
+
+  void pop_back() { --size_; }
+
+  // Exchanges the buffers if the resources match, and the limbs otherwise,
+  // which allocates only if a buffer is too short.
+  void swap(LimbVector& other) {
+    if (resource_ == other.resource_) {
+      LimbVector temporary(std::move(other));
+      other = std::move(*this);
+      *this = std::move(temporary);
+      return;
+    }
+
+    LimbVector& longer = size_ > other.size_ ? *this : other;
+    LimbVector& shorter = size_ > other.size_ ? other : *this;
+    size_t common = shorter.size_;
+    shorter.reserve(longer.size_);
+    std::swap_ranges(shorter.data_, shorter.data_ + common, longer.data_);
+    std::copy(longer.data_ + common, longer.data_ + longer.size_,
+              shorter.data_ + common);
+    std::swap(size_, other.size_);
+  }
+
+  bool operator==(const LimbVector& other) const {
+    return size_ == other.size_ &&
+           std::equal(data_, data_ + size_, other.data_);
+  }
+
+  bool operator!=(const LimbVector& other) const { return !(*this == other); }
+
+ private:
+  // Null stands for operator new, so the default vectors skip the virtual
+  // calls of the resource.
+  static std::pmr::memory_resource* Normalized(
+      std::pmr::memory_resource* resource) {
+    return resource == std::pmr::new_delete_resource() ? nullptr : resource;
+  }
+
+  bool IsInline() const { return data_ == inline_; }
+
+  Limb* Allocate(size_t count) {
+    if (resource_ == nullptr) {
+      return new Limb[count];
+    }
+    return static_cast<Limb*>(
+        resource_->allocate(count * sizeof(Limb), alignof(Limb)));
+  }
+
+  void Release() {
+    if (!IsInline()) {
+      if (resource_ == nullptr) {
+        delete[] data_;
+      } else {
+        resource_->deallocate(data_, capacity_ * sizeof(Limb), alignof(Limb));
+      }
+      data_ = inline_;
+      capacity_ = kInlineLimbs;
+    }
+  }
+
+  // Takes over the heap buffer of `other`, or copies its inline limbs, and
+  // leaves `other` empty. *this must not own a heap buffer, and must share
+  // the resource of `other`.
+  void MoveFrom(LimbVector& other) {
+    size_ = other.size_;
+    if (other.IsInline()) {
+      std::copy(other.inline_, other.inline_ + other.size_, inline_);
+    } else {
+      data_ = other.data_;
+      capacity_ = other.capacity_;
+      other.data_ = other.inline_;
+      other.capacity_ = kInlineLimbs;
+    }
+    other.size_ = 0;
+  }
+
+  static inline thread_local std::pmr::memory_resource* thread_resource_ =
+      nullptr;
+
+  std::pmr::memory_resource* resource_ = thread_resource_;
+  Limb* data_ = inline_;
+  size_t size_ = 0;
+  size_t capacity_ = kInlineLimbs;
+  Limb inline_[kInlineLimbs];
+};
+
+#endif
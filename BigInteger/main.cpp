@@ -0,0 +1,1147 @@
+#define CATCH_CONFIG_MAIN
+#include "../catch.hpp"
+
+#include <memory_resource>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "big_integer.h"
+#include "big_integer.h"  // check include guards
+#include "limb_kernels.h"
+#include "wide_int.h"
+
+namespace {
+
+// Counts the limb buffers of the numbers created while it is installed with
+// a BigIntegerMemoryScope.
+class CountingResource : public std::pmr::memory_resource {
+ public:
+  explicit CountingResource(
+      std::pmr::memory_resource* upstream = std::pmr::new_delete_resource())
+      : upstream_(upstream) {}
+
+  size_t Allocations() const { return allocations_; }
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    ++allocations_;
+    return upstream_->allocate(bytes, alignment);
+  }
+
+  void do_deallocate(void* pointer, size_t bytes, size_t alignment) override {
+    upstream_->deallocate(pointer, bytes, alignment);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& other) const
+      noexcept override {
+    return this == &other;
+  }
+
+  std::pmr::memory_resource* upstream_;
+  size_t allocations_ = 0;
+};
+
+std::string ToString(const BigInteger& integer) {
+  std::ostringstream stream;
+  stream << integer;
+  return stream.str();
+}
+
+// Irregular nonzero decimal digits, so that operands built from substrings
+// of one pattern share no obvious structure.
+std::string PatternDigits(int count, int step = 7, int period = 13) {
+  std::string digits;
+  for (int i = 0; i < count; ++i) {
+    digits += static_cast<char>('1' + (i * step + i / period) % 9);
+  }
+  return digits;
+}
+
+// Restores the thresholds and the thread count of the calling thread when
+// the tests that tune them finish, even after a failed assertion.
+class SettingsGuard {
+ public:
+  SettingsGuard()
+      : thresholds_(BigInteger::Thresholds()),
+        threads_(BigInteger::Threads()) {}
+
+  SettingsGuard(const SettingsGuard&) = delete;
+  SettingsGuard& operator=(const SettingsGuard&) = delete;
+
+  ~SettingsGuard() {
+    BigInteger::Thresholds() = thresholds_;
+    if (BigInteger::Threads() != threads_) {
+      BigInteger::SetThreads(threads_);
+    }
+  }
+
+ private:
+  const BigIntegerThresholds thresholds_;
+  const size_t threads_;
+};
+
+// Operands of the multiplication tests: a has 4000 digits, b 2500 and c is
+// negative with 700.
+struct MultiplicationOperands {
+  const std::string digits = PatternDigits(4000);
+  const BigInteger a{digits.c_str()};
+  const BigInteger b{digits.substr(0, 2500).c_str()};
+  const BigInteger c = -BigInteger(digits.substr(0, 700).c_str());
+  SettingsGuard settings;
+};
+
+}  // namespace
+
+TEST_CASE("Construction", "[BigInteger]") {
+  REQUIRE(ToString(BigInteger()) == "0");
+  REQUIRE(ToString(BigInteger(0)) == "0");
+  REQUIRE(ToString(BigInteger(-42)) == "-42");
+  REQUIRE(ToString(BigInteger(INT64_MIN)) == "-9223372036854775808");
+  REQUIRE(ToString(BigInteger("+000123")) == "123");
+  REQUIRE(ToString(BigInteger("-0")) == "0");
+  REQUIRE_FALSE(BigInteger("-0").IsNegative());
+
+  const char* big = "123456789012345678901234567890123456789012345678901234567890";
+  REQUIRE(ToString(BigInteger(big)) == big);
+  REQUIRE(ToString(BigInteger("-100000000000000000000")) ==
+          "-100000000000000000000");
+
+  REQUIRE_THROWS_AS(BigInteger(std::string(50001, '7').c_str()),
+                    BigIntegerOverflow);
+  REQUIRE_NOTHROW(BigInteger(std::string(50000, '7').c_str()));
+}
+
+TEST_CASE("Comparison", "[BigInteger]") {
+  REQUIRE(BigInteger(-5) < BigInteger(3));
+  REQUIRE(BigInteger("-100000000000000000000") < BigInteger(-5));
+  REQUIRE(BigInteger("100000000000000000000") > BigInteger(INT64_MAX));
+  REQUIRE(BigInteger("18446744073709551616") >= BigInteger("18446744073709551616"));
+  REQUIRE(BigInteger("00012") == BigInteger(12));
+  REQUIRE(BigInteger(7) != BigInteger(-7));
+  REQUIRE_FALSE(static_cast<bool>(BigInteger()));
+  REQUIRE(static_cast<bool>(BigInteger(-1)));
+}
+
+TEST_CASE("Arithmetic", "[BigInteger]") {
+  BigInteger a("18446744073709551615");
+  BigInteger b("-98765432109876543210");
+
+  REQUIRE(ToString(a + 1) == "18446744073709551616");
+  REQUIRE(ToString(a + b) == "-80318688036166991595");
+  REQUIRE(ToString(b - a) == "-117212176183586094825");
+  REQUIRE(ToString(a - a) == "0");
+  REQUIRE(ToString(a * b) == "-1821900649460228180080531653015272784150");
+  REQUIRE(ToString(b * b) == "9754610579850632525677488187778997104100");
+  REQUIRE(ToString(-b) == "98765432109876543210");
+  REQUIRE(ToString(-BigInteger(0)) == "0");
+
+  BigInteger c = 5;
+  c += -10;
+  REQUIRE(ToString(c) == "-5");
+  c -= -7;
+  REQUIRE(ToString(c) == "2");
+  c *= BigInteger("-100000000000000000000");
+  REQUIRE(ToString(c) == "-200000000000000000000");
+
+  BigInteger d = -1;
+  REQUIRE(ToString(d++) == "-1");
+  REQUIRE(ToString(d) == "0");
+  REQUIRE(ToString(--d) == "-1");
+  REQUIRE(ToString(++a) == "18446744073709551616");
+  REQUIRE(ToString(--a) == "18446744073709551615");
+
+  BigInteger limit(std::string(50000, '9').c_str());
+  REQUIRE_THROWS_AS(limit * limit, BigIntegerOverflow);
+}
+
+TEST_CASE("Division", "[BigInteger]") {
+  for (int64_t a : {-17, -16, -1, 0, 1, 16, 17, 123456789}) {
+    for (int64_t b : {-5, -4, -1, 1, 4, 5, 1000}) {
+      REQUIRE(BigInteger(a) / BigInteger(b) == BigInteger(a / b));
+      REQUIRE(BigInteger(a) % BigInteger(b) == BigInteger(a % b));
+    }
+  }
+
+  BigInteger a("340282366920938463463374607431768211457");
+  BigInteger b("-18446744073709551617");
+  REQUIRE(ToString(a / b) == "-18446744073709551615");
+  REQUIRE(ToString(a % b) == "2");
+  REQUIRE(ToString(-a % b) == "-2");
+
+  BigInteger c("98765432109876543210987654321098765432109876543210");
+  BigInteger d("12345678901234567890123");
+  auto [quotient, remainder] = BigInteger::DivMod(c, d);
+  REQUIRE(ToString(quotient) == "8000000072900000663390302036");
+  REQUIRE(ToString(remainder) == "1659459519465645352782");
+  REQUIRE(quotient * d + remainder == c);
+
+  c /= -d;
+  REQUIRE(ToString(c) == "-8000000072900000663390302036");
+  c %= 1000;
+  REQUIRE(ToString(c) == "-36");
+
+  REQUIRE_THROWS_AS(a / BigInteger(), BigIntegerDivisionByZero);
+  REQUIRE_THROWS_AS(a % 0, BigIntegerDivisionByZero);
+}
+
+TEST_CASE("Squares and powers", "[BigInteger]") {
+  BigInteger x("-98765432109876543210987654321");
+  REQUIRE(ToString(BigInteger::Square(x)) ==
+          "9754610579850632525872580399356500533456774881877789971041");
+  REQUIRE(BigInteger::Square(0) == 0);
+  REQUIRE(BigInteger::Square(-3) == 9);
+
+  REQUIRE(ToString(BigInteger::Pow(3, 100)) ==
+          "515377520732011331036461129765621272702107522001");
+  REQUIRE(ToString(BigInteger::Pow(-7, 41)) ==
+          "-44567640326363195900190045974568007");
+  REQUIRE(BigInteger::Pow(x, 0) == 1);
+  REQUIRE(BigInteger::Pow(0, 0) == 1);
+  REQUIRE(BigInteger::Pow(0, 5) == 0);
+  REQUIRE(BigInteger::Pow(-1, 1ULL << 63) == 1);
+  REQUIRE(BigInteger::Pow(-1, (1ULL << 63) + 1) == -1);
+  REQUIRE(BigInteger::Pow(x, 5) == x * x * x * x * x);
+
+  REQUIRE_THROWS_AS(BigInteger::Pow(2, 64 * BigInteger::MaxLimbs()),
+                    BigIntegerOverflow);
+  REQUIRE_THROWS_AS(BigInteger::Pow(x, 1ULL << 40), BigIntegerOverflow);
+  REQUIRE_NOTHROW(BigInteger::Pow(2, 64 * BigInteger::MaxLimbs() - 1));
+}
+
+TEST_CASE("Modular exponentiation", "[BigInteger]") {
+  REQUIRE(BigInteger::PowMod(4, 13, 497) == 445);
+  REQUIRE(BigInteger::PowMod(-2, 3, 5) == 2);
+  REQUIRE(BigInteger::PowMod(4, 13, -497) == 445);
+  REQUIRE(BigInteger::PowMod(7, 0, 10) == 1);
+  REQUIRE(BigInteger::PowMod(7, 0, 1) == 0);
+  REQUIRE(BigInteger::PowMod(0, 5, 7) == 0);
+
+  BigInteger a("340282366920938463463374607431768211457");
+  BigInteger c("98765432109876543210987654321098765432109876543210");
+  BigInteger d("12345678901234567890123");
+  REQUIRE(ToString(BigInteger::PowMod(c, d, a)) ==
+          "319681800192060428828304315519446041603");
+  BigInteger even(("1" + std::string(30, '0')).c_str());
+  REQUIRE(ToString(BigInteger::PowMod(-d, c, even)) ==
+          "162338509622136124867138354649");
+
+  // 2^521 - 1 is prime, so Fermat's little theorem applies.
+  BigInteger prime = 1;
+  for (int i = 0; i < 521; ++i) {
+    prime *= 2;
+  }
+  --prime;
+  REQUIRE(BigInteger::PowMod(3, prime - 1, prime) == 1);
+  REQUIRE(BigInteger::PowMod(c, prime, prime) == c);
+
+  REQUIRE_THROWS_AS(BigInteger::PowMod(2, 3, 0), BigIntegerDivisionByZero);
+  REQUIRE_THROWS_AS(BigInteger::PowMod(2, -3, 5), std::invalid_argument);
+}
+
+TEST_CASE("Modular reduction contexts", "[BigInteger]") {
+  CountingResource counter;
+  BigIntegerMemoryScope counting(&counter);
+  using ModContext = BigInteger::ModContext;
+
+  BigInteger modulus("340282366920938463463374607431768211457");
+  BigInteger a("98765432109876543210987654321098765432109876543210");
+  BigInteger b("-12345678901234567890123");
+
+  for (auto method : {ModContext::Method::kBarrett,
+                      ModContext::Method::kMontgomery}) {
+    ModContext context(-modulus, method);
+    REQUIRE(context.Modulus() == modulus);
+    REQUIRE(context.GetMethod() == method);
+
+    REQUIRE(context.Reduce(a) == a % modulus);
+    REQUIRE(context.Reduce(b) == b + modulus);
+    REQUIRE(context.Reduce(a * a * a) == a * a * a % modulus);
+    REQUIRE(context.Reduce(modulus) == 0);
+    REQUIRE(context.AddMod(a, b) == (a + b) % modulus);
+    REQUIRE(context.SubMod(b, a) == (b - a) % modulus + modulus);
+    REQUIRE(context.MulMod(a, b) == a * b % modulus + modulus);
+    REQUIRE(context.MulMod(a, 0) == 0);
+  }
+
+  ModContext even(BigInteger(1000000007) * 1024);
+  std::vector<BigInteger> values{a, b, a * a, -a * a * a, 5};
+  std::vector<BigInteger> expected;
+  for (const auto& value : values) {
+    BigInteger remainder = value % even.Modulus();
+    expected.push_back(remainder.IsNegative() ? remainder + even.Modulus()
+                                              : remainder);
+  }
+
+  even.Reduce(values);
+  REQUIRE(values == expected);
+
+  values = {a * a, b * b};
+  even.Reduce(values);
+  values = {a * a, b * b};
+  size_t before = counter.Allocations();
+  even.Reduce(values);
+  size_t after = counter.Allocations();
+  REQUIRE(after == before);
+
+  REQUIRE_THROWS_AS(ModContext(0), BigIntegerDivisionByZero);
+  REQUIRE_THROWS_AS(ModContext(10, ModContext::Method::kMontgomery),
+                    std::invalid_argument);
+}
+
+TEST_CASE("Greatest common divisor", "[BigInteger]") {
+  REQUIRE(BigInteger::Gcd(12, 18) == 6);
+  REQUIRE(BigInteger::Gcd(-12, 18) == 6);
+  REQUIRE(BigInteger::Gcd(12, -18) == 6);
+  REQUIRE(BigInteger::Gcd(0, -7) == 7);
+  REQUIRE(BigInteger::Gcd(0, 0) == 0);
+
+  BigInteger g("340282366920938463463374607431768211457");
+  BigInteger u("98765432109876543210987654321098765432109876543210");
+  BigInteger v("-12345678901234567890123");
+  REQUIRE(BigInteger::Gcd(g * u, g * v) == g * BigInteger::Gcd(u, v));
+
+  for (auto [a, b] : {std::pair<BigInteger, BigInteger>(g * u, g * v),
+                      {u, v}, {v, u}, {-u, g}, {g, 0}, {0, v}, {u, u}}) {
+    auto [gcd, x, y] = BigInteger::ExtendedGcd(a, b);
+    REQUIRE(gcd == BigInteger::Gcd(a, b));
+    REQUIRE(a * x + b * y == gcd);
+    if (b != 0) {
+      REQUIRE(x >= 0);
+      REQUIRE(x * gcd < (b.IsNegative() ? -b : b));
+    }
+  }
+  REQUIRE(BigInteger::ExtendedGcd(-5, 0) ==
+          std::make_tuple(BigInteger(5), BigInteger(-1), BigInteger()));
+  REQUIRE(BigInteger::ExtendedGcd(0, 0) ==
+          std::make_tuple(BigInteger(), BigInteger(), BigInteger()));
+
+  REQUIRE(BigInteger::ModInverse(3, 7) == 5);
+  REQUIRE(BigInteger::ModInverse(-3, 7) == 2);
+  REQUIRE(BigInteger::ModInverse(3, -7) == 5);
+  REQUIRE(BigInteger::ModInverse(5, 1) == 0);
+  BigInteger inverse = BigInteger::ModInverse(u, g);
+  REQUIRE(inverse * u % g == 1);
+  REQUIRE(inverse < g);
+  REQUIRE_THROWS_AS(BigInteger::ModInverse(6, 9), std::invalid_argument);
+  REQUIRE_THROWS_AS(BigInteger::ModInverse(6, 0), BigIntegerDivisionByZero);
+}
+
+TEST_CASE("Gcd tiers", "[BigInteger]") {
+  // Consecutive Fibonacci numbers: every quotient is 1.
+  BigInteger fib_a = 1;
+  BigInteger fib_b = 0;
+  for (int i = 0; i < 40000; ++i) {
+    fib_b += fib_a;
+    std::swap(fib_a, fib_b);
+  }
+
+  std::string digits = PatternDigits(20000);
+  BigInteger common(digits.substr(0, 3000).c_str());
+  BigInteger a = common * BigInteger(digits.substr(3000, 9000).c_str());
+  BigInteger b = common * BigInteger(digits.substr(12000, 8000).c_str());
+
+  SettingsGuard settings;
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+  for (size_t limbs : {8, 50, 200, 5000}) {
+    thresholds.gcd_limbs = limbs;
+    REQUIRE(BigInteger::Gcd(fib_a, fib_b) == 1);
+    REQUIRE(BigInteger::ModInverse(fib_b, fib_a) * fib_b % fib_a == 1);
+
+    BigInteger gcd = BigInteger::Gcd(a, b);
+    REQUIRE(a % gcd == 0);
+    REQUIRE(b % gcd == 0);
+    REQUIRE(BigInteger::Gcd(a / gcd, b / gcd) == 1);
+    REQUIRE(gcd % common == 0);
+
+    auto [extended, x, y] = BigInteger::ExtendedGcd(a, b);
+    REQUIRE(extended == gcd);
+    REQUIRE(a * x + b * y == gcd);
+  }
+}
+
+TEST_CASE("Roots", "[BigInteger]") {
+  REQUIRE(BigInteger::ISqrt(0) == 0);
+  REQUIRE(BigInteger::ISqrt(1) == 1);
+  REQUIRE(BigInteger::ISqrt(15) == 3);
+  REQUIRE(BigInteger::ISqrt(16) == 4);
+  REQUIRE(BigInteger::IRoot(-27, 3) == -3);
+  REQUIRE(BigInteger::IRoot(-26, 3) == -2);
+  REQUIRE(BigInteger::IRoot(1000, 1) == 1000);
+  REQUIRE(BigInteger::IRoot(1000, 64) == 1);
+
+  BigInteger x("98765432109876543210987654321098765432109876543210");
+  REQUIRE(ToString(BigInteger::ISqrt(x)) == "9938079900558082311789231");
+  REQUIRE(ToString(BigInteger::IRoot(x, 3)) == "46224084958442383");
+  REQUIRE(BigInteger::IRoot(x, 166) == 2);
+  REQUIRE(BigInteger::IRoot(x, 167) == 1);
+
+  // (10^k + 1)^n and its neighbours, around 4000 digits.
+  for (uint64_t n : {2, 3, 7, 50}) {
+    BigInteger root = BigInteger(("1" + std::string(4000 / n, '0')).c_str());
+    ++root;
+    BigInteger power = BigInteger::Pow(root, n);
+    REQUIRE(BigInteger::IRoot(power, n) == root);
+    REQUIRE(BigInteger::IRoot(power - 1, n) == root - 1);
+    REQUIRE(BigInteger::IRoot(power + 1, n) == root);
+    if (n % 2 == 1) {
+      REQUIRE(BigInteger::IRoot(-power, n) == -root);
+    }
+  }
+
+  REQUIRE(BigInteger::IsPerfectSquare(0));
+  REQUIRE(BigInteger::IsPerfectSquare(1));
+  REQUIRE(BigInteger::IsPerfectSquare(x * x));
+  REQUIRE_FALSE(BigInteger::IsPerfectSquare(x * x + 1));
+  REQUIRE_FALSE(BigInteger::IsPerfectSquare(x * x - 1));
+  REQUIRE_FALSE(BigInteger::IsPerfectSquare(-4));
+  REQUIRE_FALSE(BigInteger::IsPerfectSquare(x * (x + 1)));
+
+  REQUIRE_THROWS_AS(BigInteger::ISqrt(-1), std::invalid_argument);
+  REQUIRE_THROWS_AS(BigInteger::IRoot(-16, 4), std::invalid_argument);
+  REQUIRE_THROWS_AS(BigInteger::IRoot(16, 0), std::invalid_argument);
+}
+
+TEST_CASE("Combinatorics", "[BigInteger]") {
+  REQUIRE(BigInteger::Factorial(0) == 1);
+  REQUIRE(BigInteger::Factorial(1) == 1);
+  REQUIRE(BigInteger::Factorial(5) == 120);
+  REQUIRE(ToString(BigInteger::Factorial(25)) ==
+          "15511210043330985984000000");
+
+  REQUIRE(BigInteger::Binomial(5, 7) == 0);
+  REQUIRE(BigInteger::Binomial(7, 0) == 1);
+  REQUIRE(BigInteger::Binomial(7, 7) == 1);
+  REQUIRE(BigInteger::Binomial(7, 3) == 35);
+  REQUIRE(ToString(BigInteger::Binomial(100, 50)) ==
+          "100891344545564193334812497256");
+  REQUIRE(ToString(BigInteger::Binomial(1000000000000, 3)) ==
+          "166666666666166666666667000000000000");
+  REQUIRE(ToString(BigInteger::Binomial((1ULL << 63) + 5, 2)) ==
+          "42535295865117307974427000094817517578");
+
+  REQUIRE(BigInteger::Primorial(1) == 1);
+  REQUIRE(BigInteger::Primorial(2) == 2);
+  REQUIRE(BigInteger::Primorial(30) == 6469693230);
+
+  BigInteger factorial = 1;
+  for (int i = 2; i <= 3000; ++i) {
+    factorial *= i;
+  }
+  REQUIRE(BigInteger::Factorial(3000) == factorial);
+  BigInteger binomial = BigInteger::Binomial(3000, 1000);
+  REQUIRE(binomial * BigInteger::Factorial(1000) *
+              BigInteger::Factorial(2000) ==
+          factorial);
+
+  BigInteger primorial = BigInteger::Primorial(20000);
+  REQUIRE(BigInteger::Threads() == 1);
+  {
+    SettingsGuard settings;
+    BigInteger::SetThreads(4);
+    BigInteger::Thresholds().parallel_limbs = 20;
+    REQUIRE(BigInteger::Factorial(3000) == factorial);
+    REQUIRE(BigInteger::Binomial(3000, 1000) == binomial);
+    REQUIRE(BigInteger::Primorial(20000) == primorial);
+  }
+  REQUIRE(BigInteger::Threads() == 1);
+  BigInteger::SetThreads(0);
+  REQUIRE(BigInteger::Threads() == 1);
+
+  REQUIRE_THROWS_AS(BigInteger::Factorial(100000), BigIntegerOverflow);
+  REQUIRE_THROWS_AS(BigInteger::Binomial(1000000, 500000),
+                    BigIntegerOverflow);
+  REQUIRE_THROWS_AS(BigInteger::Primorial(1000000), BigIntegerOverflow);
+}
+
+TEST_CASE("Bitwise operators", "[BigInteger]") {
+  for (int64_t x : {-9, -8, -1, 0, 1, 6, 13}) {
+    for (int64_t y : {-5, -4, 0, 3, 12}) {
+      REQUIRE((BigInteger(x) & y) == (x & y));
+      REQUIRE((BigInteger(x) | y) == (x | y));
+      REQUIRE((BigInteger(x) ^ y) == (x ^ y));
+    }
+    REQUIRE(~BigInteger(x) == ~x);
+    REQUIRE((BigInteger(x) >> 2) == (x >> 2));
+    REQUIRE((BigInteger(x) << 3) == x * 8);
+    REQUIRE((BigInteger(x) >> 100) == (x < 0 ? -1 : 0));
+    for (size_t i = 0; i < 70; ++i) {
+      bool bit = ((x >> std::min<size_t>(i, 63)) & 1) != 0;
+      REQUIRE(BigInteger(x).TestBit(i) == bit);
+    }
+  }
+
+  BigInteger a = -(BigInteger(1) << 130) + 12345;
+  BigInteger b = (BigInteger(1) << 100) - 7;
+  REQUIRE((a & b) == 12345);
+  REQUIRE(ToString(a | b) == "-1361129466416103253625269028230369640455");
+  REQUIRE(ToString(a ^ b) == "-1361129466416103253625269028230369652800");
+  REQUIRE(ToString(~a) == "1361129467683753853853498429727072833478");
+  REQUIRE(ToString(a >> 70) == "-1152921504606846976");
+  REQUIRE((a << 70) >> 70 == a);
+  REQUIRE((-(BigInteger(1) << 130) >> 130) == -1);
+
+  BigInteger c = a;
+  c <<= 135;
+  REQUIRE(c == a << 135);
+  c >>= 135;
+  REQUIRE(c == a);
+  c ^= c;
+  REQUIRE(c == 0);
+  c = b;
+  c &= c;
+  REQUIRE(c == b);
+
+  REQUIRE(BigInteger(0).BitLength() == 0);
+  REQUIRE(a.BitLength() == 130);
+  REQUIRE(b.PopCount() == 98);
+  REQUIRE(BigInteger(0).CountTrailingZeros() == 0);
+  REQUIRE((BigInteger(-3) << 200).CountTrailingZeros() == 200);
+  REQUIRE(a.TestBit(0));
+  REQUIRE_FALSE(a.TestBit(1));
+  REQUIRE(a.TestBit(130));
+  REQUIRE(a.TestBit(1000));
+
+  BigIntegerLimitScope limit(4);
+  REQUIRE_THROWS_AS(BigInteger(1) << 256, BigIntegerOverflow);
+  REQUIRE_THROWS_AS(BigInteger(1) << 1000000, BigIntegerOverflow);
+  REQUIRE((BigInteger(1) << 255).BitLength() == 256);
+  BigInteger top = BigInteger(1) << 255;
+  REQUIRE_THROWS_AS(top <<= 1, BigIntegerOverflow);
+  REQUIRE(top == BigInteger(1) << 255);
+}
+
+TEST_CASE("In-place operators", "[BigInteger]") {
+  CountingResource counter;
+  BigIntegerMemoryScope counting(&counter);
+  BigInteger a("-123456789012345678901234567890123456789");
+  BigInteger b("98765432109876543210987654321");
+  BigInteger sum;
+  BigInteger product;
+
+  auto run = [&]() {
+    sum = a;
+    sum += b;
+    sum -= a;
+    sum += sum;
+    sum -= b;
+    ++sum;
+    --sum;
+    product = a;
+    product *= b;
+    product -= sum;
+    product *= a;
+  };
+
+  run();
+  REQUIRE(sum == b);
+  REQUIRE(product == (a * b - b) * a);
+
+  // Once the buffers have grown, the same sequence allocates nothing.
+  size_t before = counter.Allocations();
+  for (int i = 0; i < 100; ++i) {
+    run();
+  }
+  size_t after = counter.Allocations();
+  REQUIRE(after == before);
+
+  BigInteger c = -1;
+  ++c;
+  REQUIRE(!c);
+  --c;
+  REQUIRE(c == -1);
+  c -= c;
+  REQUIRE(!c);
+  REQUIRE(!c.IsNegative());
+
+  BigInteger d("18446744073709551615");
+  ++d;
+  REQUIRE(ToString(d) == "18446744073709551616");
+  --d;
+  REQUIRE(ToString(d) == "18446744073709551615");
+  d -= BigInteger("36893488147419103230");
+  REQUIRE(ToString(d) == "-18446744073709551615");
+}
+
+TEST_CASE("Small values", "[BigInteger]") {
+  CountingResource counter;
+  BigIntegerMemoryScope counting(&counter);
+  size_t before = counter.Allocations();
+
+  BigInteger a = 1;
+  BigInteger b("-18446744073709551615");
+  BigInteger c = a - b;
+  BigInteger d = b * b;
+  BigInteger e = d / c;
+  BigInteger f = d % BigInteger(1000000007);
+  c += b;
+  c *= b;
+  ++e;
+  --f;
+  bool less = b < a;
+
+  size_t after = counter.Allocations();
+  REQUIRE(after == before);
+
+  REQUIRE(less);
+  REQUIRE(ToString(c) == "-18446744073709551615");
+  REQUIRE(ToString(d) == "340282366920938463426481119284349108225");
+  REQUIRE(ToString(e) == "18446744073709551615");
+  REQUIRE(ToString(f) == "114944268");
+
+  // Results beyond two limbs move to the heap and keep working.
+  d *= b;
+  REQUIRE(ToString(d) ==
+          "-6277101735386680762814942322444851025767571854389858533375");
+  d /= b;
+  d -= d;
+  REQUIRE(!d);
+}
+
+TEST_CASE("Lazy expressions", "[BigInteger]") {
+  CountingResource counter;
+  BigIntegerMemoryScope counting(&counter);
+  BigInteger a("-123456789012345678901234567890123456789");
+  BigInteger b("98765432109876543210987654321");
+  BigInteger c("31415926535897932384626433832795028841971");
+  BigInteger d = -7;
+
+  BigInteger x(Lazy(a) * b + c);
+  REQUIRE(x == a * b + c);
+  x = Lazy(a) * b - Lazy(c) * d;
+  REQUIRE(x == a * b - c * d);
+  x = a - Lazy(b) * 3 + c + 5;
+  REQUIRE(x == a - b * 3 + c + 5);
+  x = -(Lazy(c) * c);
+  REQUIRE(x == -(c * c));
+
+  x = 0;
+  for (char digit : std::string("98765432109876543210987654321")) {
+    x = Lazy(x) * 10 + (digit - '0');
+  }
+  REQUIRE(x == b);
+
+  x = c;
+  x += Lazy(a) * d;
+  REQUIRE(x == c + a * d);
+  x -= Lazy(x) * x - b;
+  REQUIRE(x == (c + a * d) - ((c + a * d) * (c + a * d) - b));
+
+  auto run = [&]() {
+    x = Lazy(a) * b - Lazy(c) * d;
+    x += Lazy(a) * c;
+  };
+
+  run();
+  size_t before = counter.Allocations();
+  for (int i = 0; i < 100; ++i) {
+    run();
+  }
+  size_t after = counter.Allocations();
+  REQUIRE(after == before);
+  REQUIRE(x == a * b - c * d + a * c);
+
+  BigInteger y = Lazy(a) * b + c;
+  REQUIRE(y == a * b + c);
+
+  // A result over the limit throws and leaves the destination unchanged.
+  BigInteger full = (BigInteger(1) << 256) - 1;
+  BigIntegerLimitScope limit(4);
+  y = Lazy(a) * b;
+  REQUIRE(y == a * b);
+  REQUIRE_THROWS_AS(y = Lazy(c) * c, BigIntegerOverflow);
+  REQUIRE_THROWS_AS(y += Lazy(c) * c, BigIntegerOverflow);
+  REQUIRE(y == a * b);
+  y = full;
+  REQUIRE_THROWS_AS(y = Lazy(full) + full, BigIntegerOverflow);
+  REQUIRE_THROWS_AS(y += Lazy(full) * 2, BigIntegerOverflow);
+  REQUIRE(y == full);
+}
+
+TEST_CASE("Rvalue operators", "[BigInteger]") {
+  CountingResource counter;
+  BigIntegerMemoryScope counting(&counter);
+  BigInteger a("-123456789012345678901234567890123456789");
+  BigInteger b("98765432109876543210987654321");
+  BigInteger c("31415926535897932384626433832795028841971");
+
+  BigInteger expected = a;
+  expected += b;
+  expected += c;
+  expected += a;
+  REQUIRE(a + b + c + a == expected);
+  REQUIRE(a + (b + (c + a)) == expected);
+  REQUIRE((a + b) + (c + a) == expected);
+
+  REQUIRE(a - (b - c) == a - b + c);
+  REQUIRE((a - b) - (c - a) == a - b - c + a);
+  REQUIRE(BigInteger(5) - (a + b) == BigInteger(5) - a - b);
+  REQUIRE(a * (b * c) == (a * b) * c);
+  REQUIRE((a * b) * (c * a) == a * b * c * a);
+  REQUIRE(-(a * b) == a * -b);
+  REQUIRE(-(a - a) == 0);
+
+  BigInteger sum = a * b;
+  size_t before = counter.Allocations();
+  sum = std::move(sum) + a + b + c;
+  size_t after = counter.Allocations();
+  REQUIRE(after == before);
+  REQUIRE(sum == a * b + a + b + c);
+}
+
+TEST_CASE("Wide integers", "[WideInt]") {
+  using Int128 = WideInt<128>;
+  using UInt256 = WideUInt<256>;
+
+  static_assert(sizeof(WideInt<1024>) == 128);
+  static_assert(Int128(-1) + Int128(1) == Int128(0));
+  static_assert(Int128(-7) / Int128(2) == Int128(-3));
+  static_assert(Int128(-7) % Int128(2) == Int128(-1));
+  static_assert(UInt256(0) - UInt256(1) == UInt256::Max());
+  static_assert(Int128::Max() + Int128(1) == Int128::Min());
+  static_assert(Int128(-3) < Int128(2) && UInt256(-3) > UInt256(2));
+
+  constexpr UInt256 n = UInt256::Max() - UInt256(12345);
+  constexpr UInt256 d = UInt256(~0ULL) * UInt256(~0ULL) * UInt256(977);
+  static_assert(n / d * d + n % d == n && n % d < d);
+
+  BigInteger a("-123456789012345678901234567890123456");
+  BigInteger b("98765432109876543210987");
+  Int128 x(a);
+  Int128 y(b);
+  REQUIRE(x.ToBigInteger() == a);
+  REQUIRE(x.ToString() == a.ToString());
+  REQUIRE((x + y).ToBigInteger() == a + b);
+  REQUIRE((x - y).ToBigInteger() == a - b);
+  REQUIRE((x / y).ToBigInteger() == a / b);
+  REQUIRE((x % y).ToBigInteger() == a % b);
+  REQUIRE((x / Int128(-977)).ToBigInteger() == a / -977);
+  REQUIRE((x % Int128(-977)).ToBigInteger() == a % -977);
+
+  BigInteger two_128 = BigInteger("340282366920938463463374607431768211456");
+  REQUIRE((x * y).ToBigInteger() ==
+          (a * b % two_128 + two_128) % two_128 - two_128);
+
+  UInt256 u(a * a);
+  UInt256 v(b * b);
+  REQUIRE((u * v).ToBigInteger() == a * a * b * b % (two_128 * two_128));
+  REQUIRE((u / v).ToBigInteger() == a * a / (b * b));
+  REQUIRE((u % v).ToBigInteger() == a * a % (b * b));
+  REQUIRE((u / UInt256(b)).ToBigInteger() == a * a / b);
+  REQUIRE(UInt256::Max().ToBigInteger() == two_128 * two_128 - 1);
+
+  REQUIRE(Int128::Min().ToBigInteger() == -(two_128 / 2));
+  REQUIRE(Int128(-(two_128 / 2)) == Int128::Min());
+  REQUIRE_THROWS_AS(Int128(two_128 / 2), BigIntegerOverflow);
+  REQUIRE_THROWS_AS(UInt256(BigInteger(-1)), BigIntegerOverflow);
+  REQUIRE_THROWS_AS(x / Int128(0), BigIntegerDivisionByZero);
+
+  std::istringstream stream("-42");
+  Int128 z;
+  stream >> z;
+  REQUIRE(z == -42);
+  std::ostringstream output;
+  output << --z;
+  REQUIRE(output.str() == "-43");
+}
+
+TEST_CASE("Wide integer division", "[WideInt]") {
+  using Int256 = WideInt<256>;
+  using UInt256 = WideUInt<256>;
+  using Int1024 = WideInt<1024>;
+
+  // Divisors of 2 to 16 limbs, with and without the top bit of their top
+  // limb set.
+  const BigInteger two_64("18446744073709551616");
+  std::vector<BigInteger> divisors;
+  for (int digits : {20, 39, 40, 58, 77, 100, 200, 300}) {
+    divisors.emplace_back(PatternDigits(digits, 5, 11).c_str());
+  }
+  divisors.push_back(two_64 * two_64 - 1);
+  divisors.push_back(two_64 * two_64 * two_64 - 1);
+  divisors.push_back(two_64 * two_64 * two_64 / 2 + 1);
+
+  const BigInteger wide(PatternDigits(300).c_str());
+  const BigInteger narrow = wide % (two_64 * two_64 * two_64 * two_64 / 2);
+  for (const BigInteger& divisor : divisors) {
+    for (int sign : {1, -1}) {
+      const BigInteger a = wide * sign;
+      const BigInteger b = divisor * sign;
+      REQUIRE((Int1024(a) / Int1024(divisor)).ToBigInteger() == a / divisor);
+      REQUIRE((Int1024(a) % Int1024(divisor)).ToBigInteger() == a % divisor);
+      REQUIRE((Int1024(wide) / Int1024(b)).ToBigInteger() == wide / b);
+      REQUIRE((Int1024(wide) % Int1024(b)).ToBigInteger() == wide % b);
+
+      if (divisor.BitLength() < 256) {
+        const BigInteger c = narrow * sign;
+        REQUIRE((Int256(c) / Int256(divisor)).ToBigInteger() == c / divisor);
+        REQUIRE((Int256(c) % Int256(divisor)).ToBigInteger() == c % divisor);
+        REQUIRE((UInt256(narrow) / UInt256(divisor)).ToBigInteger() ==
+                narrow / divisor);
+        REQUIRE((UInt256(narrow) % UInt256(divisor)).ToBigInteger() ==
+                narrow % divisor);
+      }
+    }
+  }
+
+  REQUIRE(UInt256::Max() / UInt256::Max() == UInt256(1));
+  REQUIRE(UInt256(7) / UInt256::Max() == UInt256(0));
+  REQUIRE(UInt256(7) % UInt256::Max() == UInt256(7));
+}
+
+TEST_CASE("Stream", "[BigInteger]") {
+  std::istringstream stream("-12345678901234567890123 42 +7");
+  BigInteger a;
+  BigInteger b = -3;
+  BigInteger c;
+  stream >> a >> b >> c;
+
+  REQUIRE(ToString(a) == "-12345678901234567890123");
+  REQUIRE(ToString(b) == "42");
+  REQUIRE(ToString(c) == "7");
+
+  // Input over the limit throws and leaves the target unchanged.
+  BigIntegerLimitScope limit(2);
+  std::istringstream big("340282366920938463463374607431768211457 " +
+                         std::string(200, '9'));
+  REQUIRE_THROWS_AS(big >> b, BigIntegerOverflow);
+  REQUIRE_THROWS_AS(big >> b, BigIntegerOverflow);
+  REQUIRE(ToString(b) == "42");
+}
+
+TEST_CASE("Radix conversion", "[BigInteger]") {
+  REQUIRE(BigInteger().ToString() == "0");
+  REQUIRE(BigInteger().ToString(2) == "0");
+  REQUIRE(BigInteger(5).ToString(2) == "101");
+  REQUIRE(BigInteger(-255).ToString(16) == "-ff");
+  REQUIRE(BigInteger(35).ToString(36) == "z");
+
+  BigInteger a("340282366920938463463374607431768211457");
+  REQUIRE(a.ToString() == "340282366920938463463374607431768211457");
+  REQUIRE(a.ToString(16) == "100000000000000000000000000000001");
+  REQUIRE(a.ToString(32) == "80000000000000000000000001");
+  REQUIRE(a.ToString(7) == "3115512162124626343001006330151620356026315305");
+  REQUIRE((-a).ToString(36) == "-f5lxx1zz5pnorynqglhzmsp35");
+
+  char buffer[64];
+  size_t length = a.ToChars(buffer, sizeof(buffer), 16);
+  REQUIRE(std::string(buffer, length) == "100000000000000000000000000000001");
+  REQUIRE_THROWS_AS(a.ToChars(buffer, 20), std::length_error);
+  REQUIRE_THROWS_AS(a.ToString(1), std::invalid_argument);
+  REQUIRE_THROWS_AS(a.ToString(37), std::invalid_argument);
+
+  std::string digits = "-";
+  for (int i = 0; i < 6000; ++i) {
+    digits += static_cast<char>('0' + (i * 7 + i / 29) % 10);
+  }
+  digits[1] = '9';
+  digits.replace(3000, 500, 500, '0');
+  BigInteger b(digits.c_str());
+
+  SettingsGuard settings;
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+  thresholds.conversion_limbs = BigInteger::kMaxLimbs;
+  REQUIRE(b.ToString() == digits);
+  std::string ternary = b.ToString(3);
+
+  for (size_t limbs : {1, 2, 5, 40}) {
+    thresholds.conversion_limbs = limbs;
+    REQUIRE(b.ToString() == digits);
+    REQUIRE(ToString(b) == digits);
+    REQUIRE(b.ToString(3) == ternary);
+  }
+
+  for (size_t limbs : {1, 2, 5, 1000}) {
+    thresholds.parse_limbs = limbs;
+    REQUIRE(BigInteger(digits.c_str()) == b);
+    REQUIRE(BigInteger(digits.substr(1).c_str()) == -b);
+    REQUIRE(BigInteger(("+000" + digits.substr(3000)).c_str()).ToString() ==
+            digits.substr(3500));
+  }
+}
+
+TEST_CASE_METHOD(MultiplicationOperands, "Multiplication tiers",
+                 "[BigInteger]") {
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+  thresholds.karatsuba_limbs = BigInteger::kMaxLimbs;
+  thresholds.toom3_limbs = BigInteger::kMaxLimbs;
+  thresholds.ntt_limbs = BigInteger::kMaxLimbs;
+  BigInteger ab = a * b;
+  BigInteger ac = a * c;
+
+  // Copies keep the reference products off the squaring kernels.
+  const BigInteger a_copy = a;
+  const BigInteger c_copy = c;
+  BigInteger aa = a * a_copy;
+  BigInteger cc = c * c_copy;
+  REQUIRE(a * a == aa);
+  REQUIRE(BigInteger::Square(c) == cc);
+
+  for (size_t limbs : {4, 5, 17, 48}) {
+    thresholds.karatsuba_limbs = limbs;
+    REQUIRE(a * b == ab);
+    REQUIRE(a * a == aa);
+    REQUIRE(BigInteger::Square(a) == aa);
+    REQUIRE(BigInteger::Square(c) == cc);
+    REQUIRE(c * a == ac);
+  }
+
+  for (size_t limbs : {12, 13, 50, 140}) {
+    thresholds.karatsuba_limbs = 8;
+    thresholds.toom3_limbs = limbs;
+    REQUIRE(a * b == ab);
+    REQUIRE(a * a == aa);
+    REQUIRE(BigInteger::Square(a) == aa);
+    REQUIRE(BigInteger::Square(c) == cc);
+    REQUIRE(c * a == ac);
+  }
+
+  for (size_t limbs : {1, 2, 37, 130}) {
+    thresholds.ntt_limbs = limbs;
+    REQUIRE(a * b == ab);
+    REQUIRE(a * a == aa);
+    REQUIRE(BigInteger::Square(a) == aa);
+    REQUIRE(BigInteger::Square(c) == cc);
+    REQUIRE(c * a == ac);
+  }
+}
+
+TEST_CASE_METHOD(MultiplicationOperands, "Parallel multiplication",
+                 "[BigInteger]") {
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+  thresholds.karatsuba_limbs = 8;
+  thresholds.toom3_limbs = 60;
+  const BigInteger ab = a * b;
+  const BigInteger aa = BigInteger::Square(a);
+  const BigInteger ac = a * c;
+  thresholds.ntt_limbs = 1;
+  const BigInteger ntt_ab = a * b;
+  const BigInteger ntt_aa = BigInteger::Square(a);
+  const BigInteger factorial = BigInteger::Factorial(3000);
+
+  BigInteger::SetThreads(4);
+  for (size_t limbs : {1, 8, 30, 100}) {
+    thresholds.parallel_limbs = limbs;
+    thresholds.ntt_limbs = BigInteger::kMaxLimbs;
+    REQUIRE(a * b == ab);
+    REQUIRE(BigInteger::Square(a) == aa);
+    REQUIRE(c * a == ac);
+
+    thresholds.ntt_limbs = 1;
+    REQUIRE(a * b == ntt_ab);
+    REQUIRE(BigInteger::Square(a) == ntt_aa);
+    REQUIRE(BigInteger::Factorial(3000) == factorial);
+  }
+  REQUIRE(ntt_ab == ab);
+  REQUIRE(ntt_aa == aa);
+}
+
+TEST_CASE("Division tiers", "[BigInteger]") {
+  std::string digits = PatternDigits(9000, 5, 11);
+
+  BigInteger a(digits.c_str());
+  BigInteger b(digits.substr(0, 4000).c_str());
+  BigInteger c = -BigInteger(digits.substr(0, 1300).c_str());
+
+  SettingsGuard settings;
+  BigIntegerThresholds& thresholds = BigInteger::Thresholds();
+  thresholds.division_limbs = BigInteger::kMaxLimbs;
+  auto [ab_quotient, ab_remainder] = BigInteger::DivMod(a, b);
+  auto [ac_quotient, ac_remainder] = BigInteger::DivMod(a, c);
+  auto [bc_quotient, bc_remainder] = BigInteger::DivMod(b, c);
+  REQUIRE(ab_quotient * b + ab_remainder == a);
+
+  for (size_t limbs : {2, 3, 7, 60}) {
+    thresholds.division_limbs = limbs;
+    REQUIRE(BigInteger::DivMod(a, b) ==
+            std::make_pair(ab_quotient, ab_remainder));
+    REQUIRE(BigInteger::DivMod(a, c) ==
+            std::make_pair(ac_quotient, ac_remainder));
+    REQUIRE(BigInteger::DivMod(b, c) ==
+            std::make_pair(bc_quotient, bc_remainder));
+    REQUIRE(a * b / b == a);
+  }
+}
+
+TEST_CASE("Size limit", "[BigInteger]") {
+  const size_t limit = BigInteger::MaxLimbs();
+  BigInteger big(std::string(40000, '9').c_str());
+
+  REQUIRE_THROWS_AS(big * big, BigIntegerOverflow);
+
+  BigInteger square;
+  {
+    BigIntegerLimitScope large(100000);
+    REQUIRE(BigInteger::MaxLimbs() == 100000);
+    square = big * big;
+    REQUIRE(square * square > big);
+    REQUIRE_NOTHROW(BigInteger(std::string(200000, '1').c_str()));
+  }
+  REQUIRE(BigInteger::MaxLimbs() == limit);
+  REQUIRE_THROWS_AS(square + 1, BigIntegerOverflow);
+  REQUIRE_THROWS_AS(square * 2, BigIntegerOverflow);
+  REQUIRE(square - square == 0);
+
+  {
+    BigIntegerLimitScope unlimited(BigInteger::kUnlimited);
+    REQUIRE(BigInteger::MaxLimbs() == BigInteger::kUnlimited);
+    BigInteger power = square * square;
+    power *= power;
+    REQUIRE(power / square / square / square == square);
+
+    BigIntegerLimitScope small(4);
+    BigInteger two_64("18446744073709551616");
+    BigInteger max_128 = two_64 * two_64 - 1;
+    REQUIRE_NOTHROW(max_128 * max_128);
+    REQUIRE_THROWS_AS(max_128 * max_128 * 2, BigIntegerOverflow);
+    REQUIRE_THROWS_AS(max_128 * square, BigIntegerOverflow);
+    REQUIRE_THROWS_AS(BigInteger(std::string(100, '9').c_str()),
+                      BigIntegerOverflow);
+  }
+  REQUIRE(BigInteger::MaxLimbs() == limit);
+}
+
+TEST_CASE("Memory resource", "[BigInteger]") {
+  CountingResource heap;
+  BigIntegerMemoryScope counting(&heap);
+  const BigInteger a(std::string(300, '7').c_str());
+  const BigInteger b(std::string(200, '3').c_str());
+  auto compute = [&] {
+    BigInteger sum = 0;
+    for (int i = 1; i <= 20; ++i) {
+      BigInteger product = a;
+      product *= b + i;
+      sum += product - a * i;
+    }
+    return sum;
+  };
+
+  // Outside of the arena, so that they keep using `heap`.
+  const BigInteger expected = compute();
+  BigInteger kept;
+  BigInteger moved;
+
+  std::vector<unsigned char> buffer(1 << 20);
+  REQUIRE(BigInteger::MemoryResource() == &heap);
+  {
+    std::pmr::monotonic_buffer_resource arena(
+        buffer.data(), buffer.size(), std::pmr::null_memory_resource());
+    CountingResource in_arena(&arena);
+    BigIntegerMemoryScope scope(&in_arena);
+    REQUIRE(BigInteger::MemoryResource() == &in_arena);
+
+    size_t before = heap.Allocations();
+    BigInteger sum = compute();
+    BigInteger copy = sum;
+    size_t after = heap.Allocations();
+    REQUIRE(after == before);
+    REQUIRE(in_arena.Allocations() > 0);
+    REQUIRE(copy == expected);
+
+    // These two allocate from `heap`, like the numbers themselves.
+    kept = sum;
+    moved = std::move(sum);
+    REQUIRE(heap.Allocations() > after);
+
+    BigIntegerMemoryScope heap(nullptr);
+    REQUIRE(BigInteger::MemoryResource() == std::pmr::new_delete_resource());
+  }
+  REQUIRE(BigInteger::MemoryResource() == &heap);
+
+  // Limbs left in the arena would now read as all ones.
+  std::fill(buffer.begin(), buffer.end(), 0xFF);
+  REQUIRE(kept == expected);
+  REQUIRE(moved == expected);
+  REQUIRE(compute() == expected);
+}
+
+TEST_CASE("Scratch workspace", "[BigInteger]") {
+  const std::string digits = PatternDigits(8000);
+  const BigInteger a(digits.c_str());
+  const BigInteger b(digits.substr(0, 5000).c_str());
+  const BigInteger product = a * b;
+
+  // A new thread starts with an empty workspace.
+  size_t fresh_capacity = 1;
+  size_t high_water = 0;
+  size_t warm_capacity = 0;
+  size_t steady_capacity = 0;
+  bool correct = true;
+  std::thread([&] {
+    fresh_capacity = BigInteger::ScratchCapacity();
+
+    correct = correct && a * b == product && product / b == a;
+    high_water = BigInteger::ScratchHighWater();
+    warm_capacity = BigInteger::ScratchCapacity();
+
+    BigInteger quotient = product / b;
+    BigInteger again = a * b;
+    steady_capacity = BigInteger::ScratchCapacity();
+    correct = correct && quotient == a && again == product;
+  }).join();
+
+  REQUIRE(correct);
+  REQUIRE(fresh_capacity == 0);
+  REQUIRE(high_water > 0);
+  REQUIRE(warm_capacity >= high_water);
+  REQUIRE(steady_capacity == warm_capacity);
+
+  std::thread([&] {
+    BigInteger::ReserveScratch(high_water);
+    fresh_capacity = BigInteger::ScratchCapacity();
+    correct = a * b == product && product / b == a;
+    steady_capacity = BigInteger::ScratchCapacity();
+  }).join();
+
+  REQUIRE(correct);
+  REQUIRE(fresh_capacity == high_water);
+  REQUIRE(steady_capacity == high_water);
+}
+
+TEST_CASE("Limb kernels", "[BigInteger]") {
+  using limb_kernels::Limb;
+
+  // Runs of all-zero and all-one limbs exercise the long carry chains.
+  Limb state = 12345;
+  auto next = [&state] {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    Limb kind = state >> 62;
+    return kind == 0 ? 0 : kind == 1 ? ~Limb{0} : state ^ (state >> 29);
+  };
+
+  for (size_t size = 0; size < 40; ++size) {
+    std::vector<Limb> a(size), b(size);
+    for (size_t i = 0; i < size; ++i) {
+      a[i] = next();
+      b[i] = next();
+    }
+    Limb multiplier = next();
+
+    std::vector<Limb> expected = b, actual = b;
+    REQUIRE(limb_kernels::AddN(actual.data(), a.data(), actual.data(), size) ==
+            limb_kernels::AddNPortable(expected.data(), a.data(),
+                                       expected.data(), size));
+    REQUIRE(actual == expected);
+    REQUIRE(limb_kernels::SubtractN(actual.data(), a.data(), b.data(),
+                                    size) ==
+            limb_kernels::SubtractNPortable(expected.data(), a.data(),
+                                            b.data(), size));
+    REQUIRE(actual == expected);
+    REQUIRE(limb_kernels::MultiplyLimbsBy(actual.data(), a.data(), size,
+                                          multiplier) ==
+            limb_kernels::MultiplyLimbsByPortable(expected.data(), a.data(),
+                                                  size, multiplier));
+    REQUIRE(actual == expected);
+    REQUIRE(limb_kernels::AddMultipliedLimbs(actual.data(), b.data(), size,
+                                             multiplier) ==
+            limb_kernels::AddMultipliedLimbsPortable(
+                expected.data(), b.data(), size, multiplier));
+    REQUIRE(actual == expected);
+    REQUIRE(limb_kernels::SubtractMultipliedLimbs(actual.data(), a.data(),
+                                                  size, multiplier) ==
+            limb_kernels::SubtractMultipliedLimbsPortable(
+                expected.data(), a.data(), size, multiplier));
+    REQUIRE(actual == expected);
+  }
+}
@@ -0,0 +1,159 @@
+#ifndef HSE_SCRATCH_WORKSPACE_H
+#define HSE_SCRATCH_WORKSPACE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Grow-only stack of temporary limbs, one per thread, from which the
+// subquadratic multiplication and division algorithms take their scratch
+// space through ScratchBuffer. Buffers are released in reverse order of
+// allocation, so taking one is a pointer bump. When a request does not fit,
+// another block is added; once nothing is in use the blocks are merged into
+// one, so after a warm-up, or a Reserve of HighWater() limbs, the workspace
+// is a single buffer that is never reallocated.
+class ScratchWorkspace {
+ public:
+  using Limb = uint64_t;
+
+  ScratchWorkspace() = default;
+  ScratchWorkspace(const ScratchWorkspace&) = delete;
+  ScratchWorkspace& operator=(const ScratchWorkspace&) = delete;
+
+  // The workspace of the calling thread.
+  static ScratchWorkspace& ForThread() {
+    static thread_local ScratchWorkspace workspace;
+    return workspace;
+  }
+
+  // Grows the workspace to at least `limbs` limbs.
+  void Reserve(size_t limbs) {
+    if (limbs <= capacity_) {
+      return;
+    }
+
+    if (in_use_ == 0) {
+      blocks_.clear();
+      top_ = 0;
+      capacity_ = 0;
+    }
+    AddBlock(limbs - capacity_);
+  }
+
+  size_t Capacity() const { return capacity_; }
+
+  // Most limbs in use at once since the workspace was created.
+  size_t HighWater() const { return high_water_; }
+
+ private:
+  friend class ScratchBuffer;
+
+  static constexpr size_t kMinimumBlock = 1024;
+
+  struct Block {
+    std::unique_ptr<Limb[]> data;
+    size_t size;
+    size_t used;
+  };
+
+  // Position to return to when a buffer is released.
+  struct Mark {
+    size_t block;
+    size_t used;
+  };
+
+  Limb* Allocate(size_t limbs, Mark* mark) {
+    *mark = {top_, blocks_.empty() ? 0 : blocks_[top_].used};
+
+    size_t block = top_;
+    while (block < blocks_.size() &&
+           blocks_[block].size - blocks_[block].used < limbs) {
+      ++block;
+    }
+    if (block == blocks_.size()) {
+      AddBlock(std::max({limbs, capacity_, kMinimumBlock}));
+    }
+
+    top_ = block;
+    Limb* data = blocks_[block].data.get() + blocks_[block].used;
+    blocks_[block].used += limbs;
+    in_use_ += limbs;
+    high_water_ = std::max(high_water_, in_use_);
+    return data;
+  }
+
+  void Release(const Mark& mark, size_t limbs) {
+    for (size_t block = mark.block + 1; block <= top_; ++block) {
+      blocks_[block].used = 0;
+    }
+    top_ = mark.block;
+    if (!blocks_.empty()) {
+      blocks_[top_].used = mark.used;
+    }
+
+    in_use_ -= limbs;
+    if (in_use_ == 0 && blocks_.size() > 1) {
+      size_t capacity = capacity_;
+      blocks_.clear();
+      top_ = 0;
+      capacity_ = 0;
+      AddBlock(capacity);
+    }
+  }
+
+  // Appends an empty block; blocks after top_ are always empty.
+  void AddBlock(size_t limbs) {
+    blocks_.push_back({std::make_unique<Limb[]>(limbs), limbs, 0});
+    capacity_ += limbs;
+  }
+
+  std::vector<Block> blocks_;
+  size_t top_ = 0;
+  size_t capacity_ = 0;
+  size_t in_use_ = 0;
+  size_t high_water_ = 0;
+};
+
+// Zero-filled limbs from a ScratchWorkspace for the lifetime of the object.
+// Buffers of one thread must be destroyed in reverse order of construction,
+// which holding them in local variables ensures.
+class ScratchBuffer {
+ public:
+  using Limb = ScratchWorkspace::Limb;
+
+  explicit ScratchBuffer(
+      size_t size,
+      ScratchWorkspace& workspace = ScratchWorkspace::ForThread())
+      : workspace_(workspace), size_(size) {
+    data_ = workspace_.Allocate(size_, &mark_);
+    std::fill(data_, data_ + size_, 0);
+  }
+
+  ScratchBuffer(const ScratchBuffer&) = delete;
+  ScratchBuffer& operator=(const ScratchBuffer&) = delete;
+
+  ~ScratchBuffer() { workspace_.Release(mark_, size_); }
+
+  size_t size() const { return size_; }
+
+  Limb* data() { return data_; }
+  const Limb* data() const { return data_; }
+
+  Limb* begin() { return data_; }
+  Limb* end() { return data_ + size_; }
+
+  Limb& operator[](size_t index) { return data_[index]; }
+  const Limb& operator[](size_t index) const { return data_[index]; }
+
+  Limb& back() { return data_[size_ - 1]; }
+
+ private:
+  ScratchWorkspace& workspace_;
+  ScratchWorkspace::Mark mark_;
+  Limb* data_;
+  size_t size_;
+};
+
+#endif
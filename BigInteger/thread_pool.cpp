@@ -0,0 +1,179 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+
+namespace {
+
+// The pool and queue of the calling thread, if it is a worker.
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_index = 0;
+
+}  // namespace
+
+ThreadPool::ThreadPool(size_t threads) {
+  threads = std::max<size_t>(threads, 1);
+  for (size_t i = 0; i < threads; ++i) {
+    queues_.push_back(std::make_unique<Queue>());
+  }
+
+  workers_.reserve(threads - 1);
+  for (size_t i = 1; i < threads; ++i) {
+    workers_.emplace_back(&ThreadPool::Work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+
+  for (auto& worker : workers_) {
+    worker.join();
+  }
+}
+
+void ThreadPool::Invoke(const std::function<void()>* tasks, size_t count) {
+  if (count == 0) {
+    return;
+  }
+
+  size_t index = QueueIndex();
+  std::vector<Task> forks(count - 1);
+  if (!forks.empty()) {
+    {
+      // Counted before the queue lock is released, so that Take and Reclaim,
+      // which lock in the same order, never decrement an uncounted task.
+      std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+      for (size_t i = 0; i < forks.size(); ++i) {
+        forks[i].function = &tasks[i + 1];
+        queues_[index]->tasks.push_back(&forks[i]);
+      }
+      std::lock_guard<std::mutex> pending_lock(mutex_);
+      pending_ += forks.size();
+    }
+    wake_.notify_all();
+  }
+
+  Task first;
+  first.function = &tasks[0];
+  Run(&first);
+
+  // Newest first, the order in which the deque hands them out.
+  for (size_t i = forks.size(); i-- > 0;) {
+    if (Reclaim(index, &forks[i])) {
+      Run(&forks[i]);
+    }
+  }
+
+  // The tasks refer to the caller's stack, so every fork has to finish
+  // before any exception leaves this frame.
+  for (const Task& fork : forks) {
+    Wait(index, fork);
+  }
+
+  if (first.exception) {
+    std::rethrow_exception(first.exception);
+  }
+  for (const Task& fork : forks) {
+    if (fork.exception) {
+      std::rethrow_exception(fork.exception);
+    }
+  }
+}
+
+size_t ThreadPool::QueueIndex() const {
+  return current_pool == this ? current_index : 0;
+}
+
+ThreadPool::Task* ThreadPool::Take(size_t index) {
+  for (size_t i = 0; i < queues_.size(); ++i) {
+    Queue& queue = *queues_[(index + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+      continue;
+    }
+
+    Task* task;
+    if (i == 0) {
+      task = queue.tasks.back();
+      queue.tasks.pop_back();
+    } else {
+      task = queue.tasks.front();
+      queue.tasks.pop_front();
+    }
+
+    std::lock_guard<std::mutex> pending_lock(mutex_);
+    --pending_;
+    return task;
+  }
+
+  return nullptr;
+}
+
+bool ThreadPool::Reclaim(size_t index, Task* task) {
+  Queue& queue = *queues_[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  for (auto it = queue.tasks.end(); it != queue.tasks.begin();) {
+    if (*--it == task) {
+      queue.tasks.erase(it);
+      std::lock_guard<std::mutex> pending_lock(mutex_);
+      --pending_;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void ThreadPool::Run(Task* task) {
+  try {
+    (*task->function)();
+  } catch (...) {
+    task->exception = std::current_exception();
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    task->done = true;
+  }
+  wake_.notify_all();
+}
+
+void ThreadPool::Wait(size_t index, const Task& task) {
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (task.done) {
+        return;
+      }
+    }
+
+    if (Task* other = Take(index)) {
+      Run(other);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock, [&] { return task.done || pending_ > 0; });
+  }
+}
+
+void ThreadPool::Work(size_t index) {
+  current_pool = this;
+  current_index = index;
+
+  while (true) {
+    if (Task* task = Take(index)) {
+      Run(task);
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    wake_.wait(lock, [&] { return stop_ || pending_ > 0; });
+    if (stop_) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef HSE_THREAD_POOL_H
+#define HSE_THREAD_POOL_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fork-join pool behind the parallel parts of BigInteger. Every thread has a
+// deque of forked tasks: it takes its own work from the back, so nested
+// forks run depth first, and idle threads steal from the front of the
+// others' deques, where the largest pending subproblems are. A thread that
+// waits for its forks runs queued tasks meanwhile, so tasks may fork again
+// without deadlocking the pool.
+class ThreadPool {
+ public:
+  // Starts threads - 1 workers; a thread calling Invoke is the last one.
+  explicit ThreadPool(size_t threads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t Threads() const { return workers_.size() + 1; }
+
+  // Runs tasks[0, count) and returns when all of them have finished. The
+  // calling thread runs the first task itself and takes back the others
+  // that no thread has stolen by then. Rethrows the exception of the first
+  // task that threw. Safe to call from several threads at once.
+  void Invoke(const std::function<void()>* tasks, size_t count);
+
+ private:
+  struct Task {
+    const std::function<void()>* function = nullptr;
+    std::exception_ptr exception;
+    bool done = false;  // Guarded by mutex_.
+  };
+
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task*> tasks;
+  };
+
+  // Queue of the calling thread: its own for workers, 0 for every thread
+  // outside the pool.
+  size_t QueueIndex() const;
+
+  // Removes a task from the back of queue `index`, or steals one from the
+  // front of another queue. Returns null if every queue is empty.
+  Task* Take(size_t index);
+
+  // Removes `task` from queue `index` if no thread has taken it yet.
+  bool Reclaim(size_t index, Task* task);
+
+  void Run(Task* task);
+  void Wait(size_t index, const Task& task);
+  void Work(size_t index);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> workers_;
+
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  size_t pending_ = 0;  // Tasks in the queues.
+  bool stop_ = false;
+};
+
+#endif
@@ -0,0 +1,462 @@
+#ifndef HSE_WIDE_INT_H
+#define HSE_WIDE_INT_H
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include "big_integer.h"
+
+// Fixed-width integer of Bits bits (a multiple of 64) kept in a std::array
+// of limbs, for values whose bound is known in advance. It has the operator
+// surface of BigInteger, but arithmetic wraps around modulo 2^Bits like the
+// built-in types, and everything except I/O and BigInteger conversion is
+// constexpr. Signed values use two's complement; division truncates toward
+// zero. The add, subtract and multiply kernels are unrolled per width with
+// index sequences.
+template <size_t Bits, bool Signed = true>
+class WideInt {
+  static_assert(Bits >= 64 && Bits % 64 == 0,
+                "WideInt: Bits must be a positive multiple of 64");
+
+ public:
+  using Limb = BigInteger::Limb;
+
+  static constexpr size_t kLimbs = Bits / 64;
+
+ private:
+  __extension__ typedef unsigned __int128 DoubleLimb;
+  using Limbs = std::array<Limb, kLimbs>;
+  using Indices = std::make_index_sequence<kLimbs>;
+
+  Limbs limbs_{};
+
+  static constexpr Limb AddWithCarry(Limb lhs, Limb rhs, Limb& carry) {
+    Limb sum = lhs + carry;
+    Limb next_carry = static_cast<Limb>(sum < carry);
+    sum += rhs;
+    carry = next_carry + static_cast<Limb>(sum < rhs);
+    return sum;
+  }
+
+  static constexpr Limb SubtractWithBorrow(Limb lhs, Limb rhs, Limb& borrow) {
+    Limb difference = lhs - rhs;
+    Limb next_borrow = static_cast<Limb>(lhs < rhs);
+    next_borrow += static_cast<Limb>(difference < borrow);
+    difference -= borrow;
+    borrow = next_borrow;
+    return difference;
+  }
+
+  template <size_t... I>
+  static constexpr void AddLimbs(Limbs& lhs, const Limbs& rhs,
+                                 std::index_sequence<I...>) {
+    Limb carry = 0;
+    ((lhs[I] = AddWithCarry(lhs[I], rhs[I], carry)), ...);
+  }
+
+  template <size_t... I>
+  static constexpr void SubtractLimbs(Limbs& lhs, const Limbs& rhs,
+                                      std::index_sequence<I...>) {
+    Limb borrow = 0;
+    ((lhs[I] = SubtractWithBorrow(lhs[I], rhs[I], borrow)), ...);
+  }
+
+  // result[I + J] += lhs[I] * rhs[J] for every J with I + J < kLimbs.
+  template <size_t I, size_t... J>
+  static constexpr void MultiplyRow(Limbs& result, const Limbs& lhs,
+                                    const Limbs& rhs,
+                                    std::index_sequence<J...>) {
+    Limb carry = 0;
+    ((result[I + J] = AccumulateProduct(result[I + J], lhs[I], rhs[J], carry)),
+     ...);
+  }
+
+  static constexpr Limb AccumulateProduct(Limb limb, Limb lhs, Limb rhs,
+                                          Limb& carry) {
+    DoubleLimb product = static_cast<DoubleLimb>(lhs) * rhs + limb + carry;
+    carry = static_cast<Limb>(product >> 64);
+    return static_cast<Limb>(product);
+  }
+
+  // The low kLimbs limbs of lhs * rhs.
+  template <size_t... I>
+  static constexpr Limbs MultiplyLimbs(const Limbs& lhs, const Limbs& rhs,
+                                       std::index_sequence<I...>) {
+    Limbs result{};
+    (MultiplyRow<I>(result, lhs, rhs, std::make_index_sequence<kLimbs - I>()),
+     ...);
+    return result;
+  }
+
+  static constexpr void Negate(Limbs& limbs) {
+    Limb carry = 1;
+    for (auto& limb : limbs) {
+      limb = ~limb + carry;
+      carry = static_cast<Limb>(carry != 0 && limb == 0);
+    }
+  }
+
+  static constexpr int CompareMagnitude(const Limbs& lhs, const Limbs& rhs) {
+    for (size_t i = kLimbs; i-- > 0;) {
+      if (lhs[i] != rhs[i]) {
+        return lhs[i] < rhs[i] ? -1 : 1;
+      }
+    }
+    return 0;
+  }
+
+  // (high << shift) | (low >> (64 - shift)), also for a shift of 0.
+  static constexpr Limb ShiftedLimb(Limb high, Limb low, unsigned shift) {
+    return shift == 0 ? high : (high << shift) | (low >> (64 - shift));
+  }
+
+  // Unsigned division of magnitudes. One-limb divisors use native division;
+  // longer ones use limb-wise long division (Knuth, TAOCP vol. 2, 4.3.1,
+  // Algorithm D), as DivideBasecase does for BigInteger.
+  static constexpr std::pair<Limbs, Limbs> DivideMagnitude(
+      const Limbs& dividend, const Limbs& divisor) {
+    Limbs quotient{};
+    Limbs remainder{};
+
+    size_t divisor_size = kLimbs;
+    while (divisor_size > 0 && divisor[divisor_size - 1] == 0) {
+      --divisor_size;
+    }
+
+    if (divisor_size == 1) {
+      DoubleLimb current = 0;
+      for (size_t i = kLimbs; i-- > 0;) {
+        current = (current << 64) | dividend[i];
+        quotient[i] = static_cast<Limb>(current / divisor[0]);
+        current %= divisor[0];
+      }
+      remainder[0] = static_cast<Limb>(current);
+      return {quotient, remainder};
+    }
+
+    size_t dividend_size = kLimbs;
+    while (dividend_size > 0 && dividend[dividend_size - 1] == 0) {
+      --dividend_size;
+    }
+    if (dividend_size < divisor_size) {
+      return {quotient, dividend};
+    }
+
+    // Normalize so that the top bit of the divisor is set; then every
+    // quotient digit estimate is at most two too large.
+    const unsigned shift =
+        static_cast<unsigned>(__builtin_clzll(divisor[divisor_size - 1]));
+    std::array<Limb, kLimbs + 1> numerator{};
+    Limbs denominator{};
+    for (size_t i = 0; i < divisor_size; ++i) {
+      denominator[i] =
+          ShiftedLimb(divisor[i], i > 0 ? divisor[i - 1] : 0, shift);
+    }
+    for (size_t i = 0; i < dividend_size; ++i) {
+      numerator[i] =
+          ShiftedLimb(dividend[i], i > 0 ? dividend[i - 1] : 0, shift);
+    }
+    numerator[dividend_size] =
+        ShiftedLimb(0, dividend[dividend_size - 1], shift);
+
+    const Limb top = denominator[divisor_size - 1];
+    const Limb next = denominator[divisor_size - 2];
+
+    for (size_t j = dividend_size - divisor_size + 1; j-- > 0;) {
+      Limb* window = numerator.data() + j;
+      DoubleLimb estimate_numerator =
+          (static_cast<DoubleLimb>(window[divisor_size]) << 64) |
+          window[divisor_size - 1];
+
+      Limb estimate = 0;
+      DoubleLimb estimate_remainder = 0;
+      if (window[divisor_size] >= top) {
+        estimate = ~Limb{0};
+        estimate_remainder =
+            estimate_numerator - static_cast<DoubleLimb>(estimate) * top;
+      } else {
+        estimate = static_cast<Limb>(estimate_numerator / top);
+        estimate_remainder = estimate_numerator % top;
+      }
+
+      while ((estimate_remainder >> 64) == 0 &&
+             static_cast<DoubleLimb>(estimate) * next >
+                 ((estimate_remainder << 64) | window[divisor_size - 2])) {
+        --estimate;
+        estimate_remainder += top;
+      }
+
+      // window -= estimate * denominator; if that goes below zero, the
+      // estimate was one too large and the divisor is added back.
+      Limb carry = 0;
+      Limb borrow = 0;
+      for (size_t i = 0; i < divisor_size; ++i) {
+        Limb product = AccumulateProduct(0, estimate, denominator[i], carry);
+        window[i] = SubtractWithBorrow(window[i], product, borrow);
+      }
+      window[divisor_size] =
+          SubtractWithBorrow(window[divisor_size], carry, borrow);
+
+      if (borrow != 0) {
+        --estimate;
+        carry = 0;
+        for (size_t i = 0; i < divisor_size; ++i) {
+          window[i] = AddWithCarry(window[i], denominator[i], carry);
+        }
+        window[divisor_size] += carry;
+      }
+
+      quotient[j] = estimate;
+    }
+
+    for (size_t i = 0; i < divisor_size; ++i) {
+      remainder[i] = shift == 0 ? numerator[i]
+                                : (numerator[i] >> shift) |
+                                      (numerator[i + 1] << (64 - shift));
+    }
+    return {quotient, remainder};
+  }
+
+  constexpr Limbs Magnitude() const {
+    Limbs magnitude = limbs_;
+    if (IsNegative()) {
+      Negate(magnitude);
+    }
+    return magnitude;
+  }
+
+  static constexpr WideInt FromLimbs(const Limbs& limbs) {
+    WideInt result;
+    result.limbs_ = limbs;
+    return result;
+  }
+
+ public:
+  constexpr WideInt() = default;
+
+  // Built-in integers are sign-extended if they are signed and wrap around
+  // like a conversion between built-in types.
+  template <class Integer,
+            std::enable_if_t<std::is_integral_v<Integer>, int> = 0>
+  constexpr WideInt(Integer value) {  // NOLINT
+    limbs_[0] = static_cast<Limb>(value);
+    if constexpr (std::is_signed_v<Integer>) {
+      if (value < 0) {
+        for (size_t i = 1; i < kLimbs; ++i) {
+          limbs_[i] = ~Limb{0};
+        }
+      }
+    }
+  }
+
+  // Throws BigIntegerOverflow if the value is out of range.
+  explicit WideInt(const BigInteger& integer) {
+    const LimbVector& number = integer.number_;
+    if (number.size() > kLimbs || (!Signed && integer.IsNegative())) {
+      throw BigIntegerOverflow();
+    }
+
+    std::copy(number.begin(), number.end(), limbs_.begin());
+    if constexpr (Signed) {
+      // The magnitude may reach 2^(Bits - 1) only for a negative value.
+      bool top_bit = (limbs_[kLimbs - 1] >> 63) != 0;
+      if (top_bit && (!integer.IsNegative() || CompareMagnitude(
+                                                   limbs_, Min().limbs_) > 0)) {
+        throw BigIntegerOverflow();
+      }
+    }
+
+    if (integer.IsNegative()) {
+      Negate(limbs_);
+    }
+  }
+
+  explicit WideInt(const char* str) : WideInt(BigInteger(str)) {}
+
+  static constexpr WideInt Min() {
+    WideInt result;
+    if constexpr (Signed) {
+      result.limbs_[kLimbs - 1] = Limb{1} << 63;
+    }
+    return result;
+  }
+
+  static constexpr WideInt Max() { return ~Min(); }
+
+  BigInteger ToBigInteger() const {
+    BigInteger result;
+    Limbs magnitude = Magnitude();
+    result.number_ = LimbVector(magnitude.data(), magnitude.data() + kLimbs);
+    result.sign_ = IsNegative() ? -1 : 1;
+    result.Normalize();
+    return result;
+  }
+
+  explicit operator BigInteger() const { return ToBigInteger(); }
+
+  std::string ToString(int base = 10) const {
+    return ToBigInteger().ToString(base);
+  }
+
+  constexpr Limb GetLimb(size_t index) const { return limbs_[index]; }
+
+  constexpr bool IsNegative() const {
+    return Signed && (limbs_[kLimbs - 1] >> 63) != 0;
+  }
+
+  constexpr explicit operator bool() const {
+    for (Limb limb : limbs_) {
+      if (limb != 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  friend constexpr bool operator==(const WideInt& lhs, const WideInt& rhs) {
+    return CompareMagnitude(lhs.limbs_, rhs.limbs_) == 0;
+  }
+
+  friend constexpr bool operator!=(const WideInt& lhs, const WideInt& rhs) {
+    return !(lhs == rhs);
+  }
+
+  friend constexpr bool operator<(const WideInt& lhs, const WideInt& rhs) {
+    if (lhs.IsNegative() != rhs.IsNegative()) {
+      return lhs.IsNegative();
+    }
+    return CompareMagnitude(lhs.limbs_, rhs.limbs_) < 0;
+  }
+
+  friend constexpr bool operator>(const WideInt& lhs, const WideInt& rhs) {
+    return rhs < lhs;
+  }
+
+  friend constexpr bool operator<=(const WideInt& lhs, const WideInt& rhs) {
+    return !(rhs < lhs);
+  }
+
+  friend constexpr bool operator>=(const WideInt& lhs, const WideInt& rhs) {
+    return !(lhs < rhs);
+  }
+
+  constexpr WideInt operator+() const { return *this; }
+
+  constexpr WideInt operator-() const {
+    WideInt result = *this;
+    Negate(result.limbs_);
+    return result;
+  }
+
+  constexpr WideInt operator~() const {
+    WideInt result = *this;
+    for (auto& limb : result.limbs_) {
+      limb = ~limb;
+    }
+    return result;
+  }
+
+  constexpr WideInt& operator+=(const WideInt& other) {
+    AddLimbs(limbs_, other.limbs_, Indices());
+    return *this;
+  }
+
+  constexpr WideInt& operator-=(const WideInt& other) {
+    SubtractLimbs(limbs_, other.limbs_, Indices());
+    return *this;
+  }
+
+  // The low Bits bits of a product do not depend on the signs.
+  constexpr WideInt& operator*=(const WideInt& other) {
+    limbs_ = MultiplyLimbs(limbs_, other.limbs_, Indices());
+    return *this;
+  }
+
+  constexpr WideInt& operator/=(const WideInt& other) {
+    *this = DivMod(*this, other).first;
+    return *this;
+  }
+
+  constexpr WideInt& operator%=(const WideInt& other) {
+    *this = DivMod(*this, other).second;
+    return *this;
+  }
+
+  friend constexpr WideInt operator+(WideInt lhs, const WideInt& rhs) {
+    return lhs += rhs;
+  }
+
+  friend constexpr WideInt operator-(WideInt lhs, const WideInt& rhs) {
+    return lhs -= rhs;
+  }
+
+  friend constexpr WideInt operator*(WideInt lhs, const WideInt& rhs) {
+    return lhs *= rhs;
+  }
+
+  friend constexpr WideInt operator/(WideInt lhs, const WideInt& rhs) {
+    return lhs /= rhs;
+  }
+
+  friend constexpr WideInt operator%(WideInt lhs, const WideInt& rhs) {
+    return lhs %= rhs;
+  }
+
+  // Quotient rounded toward zero and remainder with the sign of the
+  // dividend, as for the built-in types.
+  static constexpr std::pair<WideInt, WideInt> DivMod(const WideInt& dividend,
+                                                      const WideInt& divisor) {
+    if (!divisor) {
+      throw BigIntegerDivisionByZero();
+    }
+
+    auto [quotient, remainder] =
+        DivideMagnitude(dividend.Magnitude(), divisor.Magnitude());
+    if (dividend.IsNegative() != divisor.IsNegative()) {
+      Negate(quotient);
+    }
+    if (dividend.IsNegative()) {
+      Negate(remainder);
+    }
+    return {FromLimbs(quotient), FromLimbs(remainder)};
+  }
+
+  constexpr WideInt& operator++() { return *this += 1; }
+
+  constexpr WideInt operator++(int) {
+    WideInt before = *this;
+    ++*this;
+    return before;
+  }
+
+  constexpr WideInt& operator--() { return *this -= 1; }
+
+  constexpr WideInt operator--(int) {
+    WideInt before = *this;
+    --*this;
+    return before;
+  }
+
+  friend std::ostream& operator<<(std::ostream& ostream,
+                                  const WideInt& integer) {
+    return ostream << integer.ToBigInteger();
+  }
+
+  friend std::istream& operator>>(std::istream& istream, WideInt& integer) {
+    BigInteger value;
+    if (istream >> value) {
+      integer = WideInt(value);
+    }
+    return istream;
+  }
+};
+
+template <size_t Bits>
+using WideUInt = WideInt<Bits, false>;
+
+#endif